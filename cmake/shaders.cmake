@@ -0,0 +1,64 @@
+# Offline shader validation with glslang. add_shaders(<target> [SPIRV])
+# checks every shaders/*.glsl of the current directory whenever it changes,
+# so that syntax errors break the build instead of showing up at runtime on
+# the target machine. With SPIRV the shaders are also compiled to SPIR-V for
+# OpenGL (ARB_gl_spirv) in ${CMAKE_CURRENT_BINARY_DIR}/spirv/, with the same
+# name and a .spv extension. The stage comes from the first letter of the
+# file name: v for vertex, f for fragment and c for compute shaders.
+#
+# Without glslangValidator the shaders are only compiled at runtime, and
+# programs looking for SPIR-V fall back to GLSL.
+
+find_program(GLSLANG_VALIDATOR glslangValidator)
+if(NOT GLSLANG_VALIDATOR)
+    message(STATUS "glslangValidator not found, shaders won't be validated")
+endif()
+
+set(SPIRV_SOURCE_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/spirv_source.cmake)
+
+function(add_shaders target)
+    if(NOT GLSLANG_VALIDATOR)
+        return()
+    endif()
+    set(spirv_dir ${CMAKE_CURRENT_BINARY_DIR}/spirv)
+    file(MAKE_DIRECTORY ${spirv_dir})
+    FILE(GLOB shaders ${CMAKE_CURRENT_SOURCE_DIR}/shaders/*.glsl)
+    set(outputs)
+    foreach(shader ${shaders})
+        get_filename_component(name ${shader} NAME_WE)
+        string(SUBSTRING ${name} 0 1 prefix)
+        if(prefix STREQUAL "v")
+            set(stage vert)
+        elseif(prefix STREQUAL "f")
+            set(stage frag)
+        elseif(prefix STREQUAL "c")
+            set(stage comp)
+        else()
+            message(FATAL_ERROR "Unknown stage of ${shader}")
+        endif()
+
+        set(stamp ${CMAKE_CURRENT_BINARY_DIR}/${name}.validated)
+        add_custom_command(OUTPUT ${stamp}
+            COMMAND ${GLSLANG_VALIDATOR} -S ${stage} ${shader}
+            COMMAND ${CMAKE_COMMAND} -E touch ${stamp}
+            DEPENDS ${shader}
+            COMMENT "Validating ${name}.glsl")
+        list(APPEND outputs ${stamp})
+
+        if(ARGN STREQUAL "SPIRV")
+            # GL SPIR-V needs GLSL 3.30 at least, see spirv_source.cmake
+            set(source ${spirv_dir}/${name}.glsl)
+            set(binary ${spirv_dir}/${name}.spv)
+            add_custom_command(OUTPUT ${binary}
+                COMMAND ${CMAKE_COMMAND} -DINPUT=${shader} -DOUTPUT=${source}
+                        -P ${SPIRV_SOURCE_SCRIPT}
+                COMMAND ${GLSLANG_VALIDATOR} -G -S ${stage} -o ${binary}
+                        ${source}
+                DEPENDS ${shader} ${SPIRV_SOURCE_SCRIPT}
+                COMMENT "Compiling ${name}.glsl to SPIR-V")
+            list(APPEND outputs ${binary})
+        endif()
+    endforeach()
+    add_custom_target(${target}_shaders ALL DEPENDS ${outputs})
+    add_dependencies(${target} ${target}_shaders)
+endfunction()
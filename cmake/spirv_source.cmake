@@ -0,0 +1,11 @@
+# Copy the GLSL shader INPUT to OUTPUT with its #version raised to 450, run
+# with cmake -P by add_shaders() before compiling it to SPIR-V. The shaders
+# target GLSL 1.50 to run on GL 3.2, while glslang only emits GL SPIR-V for
+# 3.30 and later, and the explicit locations and bindings that SPIR-V needs
+# in place of names come with 4.30. Loading SPIR-V requires GL 4.6 or
+# ARB_gl_spirv anyway. Shaders check GL_SPIRV for the SPIR-V only parts.
+
+file(READ ${INPUT} source)
+string(REGEX REPLACE "^#version [0-9]+[^\n]*" "#version 450" source
+       "${source}")
+file(WRITE ${OUTPUT} "${source}")
@@ -0,0 +1,473 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "egl_context.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+
+#include "error.h"
+
+#ifndef EGL_OPENGL_ES3_BIT_KHR
+#define EGL_OPENGL_ES3_BIT_KHR 0x0040
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// A probe taking longer than this is treated as a hung driver.
+const unsigned PROBE_TIMEOUT_S = 10;
+
+const EGLPath all_paths[] = {
+    EGLPath::surfaceless, EGLPath::pbuffer, EGLPath::device
+};
+
+// Whether the space separated |extensions| contain exactly |name|.
+bool hasExtension(const char* extensions, const char* name) {
+    if (extensions == nullptr) return false;
+    size_t length = strlen(name);
+    for (const char* s = strstr(extensions, name); s; s = strstr(s + 1, name)) {
+        if ((s == extensions || s[-1] == ' ') &&
+                (s[length] == ' ' || s[length] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+EGLDisplay openDisplay(EGLPath path) {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (path == EGLPath::device) {
+        const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (!hasExtension(client, "EGL_EXT_platform_device") ||
+                !hasExtension(client, "EGL_EXT_device_enumeration"))
+            throw Exception("missing EGL_EXT_platform_device");
+        auto queryDevices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(
+            eglGetProcAddress("eglQueryDevicesEXT"));
+        auto getPlatformDisplay =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        EGLDeviceEXT device;
+        EGLint count = 0;
+        if (!queryDevices || !getPlatformDisplay ||
+                !queryDevices(1, &device, &count) || count == 0)
+            throw Exception("no EGL device");
+        display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+    } else {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display == EGL_NO_DISPLAY)
+        throw Exception("failed to open display");
+    if (!eglInitialize(display, nullptr, nullptr))
+        throw Exception("failed to initialize EGL");
+    return display;
+}
+
+EGLConfig chooseConfig(EGLDisplay display, int version, EGLint surface_type) {
+    const EGLint visual_attribs[] = {
+        EGL_BUFFER_SIZE, 32,
+        EGL_ALPHA_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_RED_SIZE, 8,
+        EGL_RENDERABLE_TYPE, version >= 3 ? EGL_OPENGL_ES3_BIT_KHR
+                                          : EGL_OPENGL_ES2_BIT,
+        // 0 matches any config, there might be no window configs at all
+        EGL_SURFACE_TYPE, surface_type,
+        EGL_NONE
+    };
+    EGLint num_configs = 0;
+    EGLConfig config;
+    if (!eglChooseConfig(display, visual_attribs, &config, 1, &num_configs) ||
+            num_configs == 0)
+        throw Exception("no matching FB config");
+    return config;
+}
+
+// Create a context using |path| and make it current. Doesn't print anything,
+// so that it can be used in the probing processes.
+EGLContextInfo makeContext(int version, EGLPath path) {
+    EGLContextInfo info = {EGL_NO_DISPLAY, EGL_NO_SURFACE, EGL_NO_CONTEXT,
+                           path};
+    info.display = openDisplay(path);
+    try {
+        bool surfaceless = path != EGLPath::pbuffer;
+        if (surfaceless &&
+                !hasExtension(eglQueryString(info.display, EGL_EXTENSIONS),
+                              "EGL_KHR_surfaceless_context"))
+            throw Exception("missing EGL_KHR_surfaceless_context");
+        auto config = chooseConfig(info.display, version,
+                                   surfaceless ? 0 : EGL_PBUFFER_BIT);
+        eglBindAPI(EGL_OPENGL_ES_API);
+        const EGLint context_attributes[] = {
+            EGL_CONTEXT_CLIENT_VERSION, version,
+            EGL_NONE
+        };
+        info.context = eglCreateContext(info.display, config, EGL_NO_CONTEXT,
+                                        context_attributes);
+        if (info.context == EGL_NO_CONTEXT)
+            throw Exception("context creation failed");
+        if (!surfaceless) {
+            const EGLint surface_attribs[] = {
+                EGL_WIDTH, 1,
+                EGL_HEIGHT, 1,
+                EGL_NONE
+            };
+            info.surface = eglCreatePbufferSurface(info.display, config,
+                                                   surface_attribs);
+            if (info.surface == EGL_NO_SURFACE)
+                throw Exception("couldn't create pbuffer");
+        }
+        if (!eglMakeCurrent(info.display, info.surface, info.surface,
+                            info.context))
+            throw Exception("couldn't make context current");
+        if (surfaceless && !hasExtension(reinterpret_cast<const char*>(
+                    glGetString(GL_EXTENSIONS)), "GL_OES_surfaceless_context"))
+            throw Exception("missing GL_OES_surfaceless_context");
+    } catch (const Exception&) {
+        destroyEGLContext(info);
+        throw;
+    }
+    return info;
+}
+
+// Render into a small offscreen framebuffer and read the result back, which
+// works the same way with and without a surface.
+void drawFirstFrame() {
+    GLuint texture, fbo;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 16, 16, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw Exception("incomplete framebuffer");
+    glViewport(0, 0, 16, 16);
+    glClearColor(0, 0.5, 1, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+    GLubyte pixel[4];
+    glReadPixels(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &texture);
+    if (pixel[2] != 255)
+        throw Exception("wrong pixel read back");
+}
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+}
+
+// Run |task| in a child process, so that a crashing or hanging driver only
+// takes the child down. On success store what |task| returned in |result|,
+// otherwise store why it failed and return false.
+bool runInChild(const std::function<std::string()>& task, std::string* result) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        throw Exception("pipe failed");
+    fflush(stdout); // don't let the child print our buffer again
+    pid_t pid = fork();
+    if (pid < 0)
+        throw Exception("fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        // the default action of SIGALRM kills the child
+        alarm(PROBE_TIMEOUT_S);
+        std::string output;
+        try {
+            output = "ok " + task();
+        } catch (const Exception& e) {
+            output = e.what();
+        }
+        if (write(fds[1], output.data(), output.size()) < 0)
+            _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string output;
+    char buffer[256];
+    ssize_t length;
+    while ((length = read(fds[0], buffer, sizeof(buffer))) > 0)
+        output.append(buffer, length);
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+        *result = "timed out after " + std::to_string(PROBE_TIMEOUT_S) + " s";
+        return false;
+    }
+    if (WIFSIGNALED(status)) {
+        *result = "crashed with signal " + std::to_string(WTERMSIG(status));
+        return false;
+    }
+    if (output.compare(0, 3, "ok ") != 0) {
+        *result = output;
+        return false;
+    }
+    *result = output.substr(3);
+    return true;
+}
+
+// Identifies the driver behind the current context, a cached path is only
+// valid for the same one. EGL vendor and version strings are the same for all
+// Mesa drivers, the GL renderer and version aren't.
+std::string currentDriver() {
+    return std::string(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) +
+           " " + reinterpret_cast<const char*>(glGetString(GL_VERSION));
+}
+
+// Try |path| in a child process. Return the time to first frame in ms and
+// store the driver in |driver|, or return a negative number.
+double probe(int version, EGLPath path, std::string* driver) {
+    std::string result;
+    bool usable = runInChild([&] {
+        auto start = Clock::now();
+        auto info = makeContext(version, path);
+        drawFirstFrame();
+        double ms = millisecondsSince(start);
+        std::string driver = currentDriver();
+        destroyEGLContext(info);
+        return std::to_string(ms) + " " + driver;
+    }, &result);
+    if (!usable) {
+        printf("[PROBE] %s: not usable, %s\n", eglPathName(path),
+               result.c_str());
+        return -1;
+    }
+    size_t space = result.find(' ');
+    double ms = strtod(result.substr(0, space).c_str(), nullptr);
+    *driver = result.substr(space + 1);
+    printf("[PROBE] %s: %.2f ms to first frame\n", eglPathName(path), ms);
+    return ms;
+}
+
+std::string cachePath() {
+    const char* dir = getenv("XDG_CACHE_HOME");
+    if (dir) return std::string(dir) + "/egl_context_paths";
+    const char* home = getenv("HOME");
+    if (!home) return "";
+    std::string cache = std::string(home) + "/.cache";
+    mkdir(cache.c_str(), 0700); // fails harmlessly if it exists
+    return cache + "/egl_context_paths";
+}
+
+// The environment deciding what the default display connects to. A path
+// cached in a session with an X server doesn't have to work in a headless
+// job on the same machine.
+std::string environmentKey(int version) {
+    const char* platform = getenv("EGL_PLATFORM");
+    std::string key = "ES" + std::to_string(version) + " " +
+                      (platform ? platform : "default");
+    if (getenv("DISPLAY")) key += " x11";
+    if (getenv("WAYLAND_DISPLAY")) key += " wayland";
+    return key;
+}
+
+struct CachedPath {
+    std::string driver;
+    EGLPath path;
+};
+
+// The cache file has one "<environment key>\t<driver>\t<path name>" line per
+// environment.
+bool readCachedPath(const std::string& key, CachedPath* cached) {
+    std::ifstream f(cachePath());
+    std::string line;
+    while (std::getline(f, line)) {
+        size_t first = line.find('\t'), last = line.rfind('\t');
+        if (first == last || line.substr(0, first) != key)
+            continue;
+        try {
+            cached->driver = line.substr(first + 1, last - first - 1);
+            cached->path = parseEGLPath(line.substr(last + 1));
+            return true;
+        } catch (const Exception&) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Replace the line of |key|, or drop it if |cached| is null.
+void writeCachedPath(const std::string& key, const CachedPath* cached) {
+    std::string filepath = cachePath();
+    if (filepath.empty()) return;
+    std::string lines, line;
+    {
+        std::ifstream f(filepath);
+        while (std::getline(f, line)) {
+            if (line.compare(0, key.size() + 1, key + "\t") != 0)
+                lines += line + "\n";
+        }
+    }
+    std::ofstream f(filepath, std::ios::trunc);
+    f << lines;
+    if (cached)
+        f << key << "\t" << cached->driver << "\t"
+          << eglPathName(cached->path) << "\n";
+}
+
+}  // namespace
+
+const char* getEGLErrorString(EGLint error) {
+  switch (error) {
+    case EGL_SUCCESS:
+      return "EGL_SUCCESS";
+    case EGL_NOT_INITIALIZED:
+      return "EGL_NOT_INITIALIZED";
+    case EGL_BAD_ACCESS:
+      return "EGL_BAD_ACCESS";
+    case EGL_BAD_ALLOC:
+      return "EGL_BAD_ALLOC";
+    case EGL_BAD_ATTRIBUTE:
+      return "EGL_BAD_ATTRIBUTE";
+    case EGL_BAD_CONTEXT:
+      return "EGL_BAD_CONTEXT";
+    case EGL_BAD_CONFIG:
+      return "EGL_BAD_CONFIG";
+    case EGL_BAD_CURRENT_SURFACE:
+      return "EGL_BAD_CURRENT_SURFACE";
+    case EGL_BAD_DISPLAY:
+      return "EGL_BAD_DISPLAY";
+    case EGL_BAD_SURFACE:
+      return "EGL_BAD_SURFACE";
+    case EGL_BAD_MATCH:
+      return "EGL_BAD_MATCH";
+    case EGL_BAD_PARAMETER:
+      return "EGL_BAD_PARAMETER";
+    case EGL_BAD_NATIVE_PIXMAP:
+      return "EGL_BAD_NATIVE_PIXMAP";
+    case EGL_BAD_NATIVE_WINDOW:
+      return "EGL_BAD_NATIVE_WINDOW";
+    case EGL_CONTEXT_LOST:
+      return "EGL_CONTEXT_LOST";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+void printEGLErrors() {
+    EGLint error = EGL_SUCCESS;
+    do {
+        error = eglGetError();
+        if (error != EGL_SUCCESS) {
+            printf("[ERROR] %s\n", getEGLErrorString(error));
+        }
+    } while (error != EGL_SUCCESS);
+}
+
+const char* eglPathName(EGLPath path) {
+    switch (path) {
+        case EGLPath::surfaceless:
+            return "surfaceless";
+        case EGLPath::pbuffer:
+            return "pbuffer";
+        case EGLPath::device:
+            return "device";
+    }
+    return "unknown";
+}
+
+EGLPath parseEGLPath(const std::string& name) {
+    for (auto path : all_paths) {
+        if (name == eglPathName(path)) return path;
+    }
+    throw Exception("unknown EGL path " + name);
+}
+
+EGLContextInfo createEGLContext(int version) {
+    const char* forced = getenv("EGL_CONTEXT_PATH");
+    if (forced)
+        return createEGLContext(version, parseEGLPath(forced));
+
+    auto key = environmentKey(version);
+    CachedPath cached;
+    if (!getenv("EGL_CONTEXT_PROBE") && readCachedPath(key, &cached)) {
+        // Check the cached path in a child first, it might not work any more
+        // and the parent mustn't touch EGL before forking the probes. This
+        // costs a context creation, still less than probing every path.
+        std::string driver;
+        if (probe(version, cached.path, &driver) >= 0 &&
+                driver == cached.driver) {
+            printf("Using cached EGL path %s for %s\n",
+                   eglPathName(cached.path), driver.c_str());
+            return createEGLContext(version, cached.path);
+        }
+        printf("Cached EGL path %s for %s is stale\n",
+               eglPathName(cached.path), cached.driver.c_str());
+        writeCachedPath(key, nullptr);
+    }
+
+    printf("Probing EGL paths for %s\n", key.c_str());
+    double best_ms = -1;
+    for (auto candidate : all_paths) {
+        std::string driver;
+        double ms = probe(version, candidate, &driver);
+        // the first run might pay for loading the driver and its caches
+        if (ms >= 0)
+            ms = std::min(ms, probe(version, candidate, &driver));
+        if (ms >= 0 && (best_ms < 0 || ms < best_ms)) {
+            best_ms = ms;
+            cached = CachedPath{driver, candidate};
+        }
+    }
+    if (best_ms < 0)
+        throw Exception("No working EGL path");
+    writeCachedPath(key, &cached);
+    return createEGLContext(version, cached.path);
+}
+
+EGLContextInfo createEGLContext(int version, EGLPath path) {
+    auto start = Clock::now();
+    EGLContextInfo info = {EGL_NO_DISPLAY, EGL_NO_SURFACE, EGL_NO_CONTEXT,
+                           path};
+    try {
+        info = makeContext(version, path);
+        drawFirstFrame();
+    } catch (const Exception& e) {
+        printEGLErrors();
+        destroyEGLContext(info);
+        throw Exception(std::string(eglPathName(path)) + ": " + e.what());
+    }
+    printf("[EGL] %s: %.2f ms to first frame\n", eglPathName(path),
+           millisecondsSince(start));
+    return info;
+}
+
+void destroyEGLContext(const EGLContextInfo& info) {
+    if (info.display == EGL_NO_DISPLAY) return;
+    eglMakeCurrent(info.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                   EGL_NO_CONTEXT);
+    if (info.surface != EGL_NO_SURFACE)
+        eglDestroySurface(info.display, info.surface);
+    if (info.context != EGL_NO_CONTEXT)
+        eglDestroyContext(info.display, info.context);
+    eglTerminate(info.display);
+}
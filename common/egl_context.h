@@ -0,0 +1,61 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Headless EGL context creation. There are several ways to get a context
+// without a window and not every driver supports (or survives) all of them, so
+// they are tried in child processes first and the fastest working one is
+// remembered per driver and environment in ~/.cache/egl_context_paths.
+// Only linked into the programs using EGL, see the top level CMakeLists.txt.
+
+#ifndef EGL_CONTEXT_H
+#define EGL_CONTEXT_H
+
+#include <string>
+#include <EGL/egl.h>
+
+enum class EGLPath {
+    surfaceless, // default display, no surface at all
+    pbuffer,     // default display, 1x1 pbuffer
+    device,      // EGL_EXT_platform_device display, no surface
+};
+
+struct EGLContextInfo {
+    EGLDisplay display;
+    EGLSurface surface; // EGL_NO_SURFACE unless the path is pbuffer
+    EGLContext context;
+    EGLPath path;
+};
+
+const char* getEGLErrorString(EGLint error);
+
+// Print all the errors reported by eglGetError on stdout.
+void printEGLErrors();
+
+const char* eglPathName(EGLPath path);
+
+// Inverse of eglPathName, throws on unknown names.
+EGLPath parseEGLPath(const std::string& name);
+
+// Create an OpenGL ES |version| context and make it current. The path comes
+// from the EGL_CONTEXT_PATH environment variable, the cache, or probing (also
+// forced by setting EGL_CONTEXT_PROBE, or when the cached path stopped
+// working). Throws if nothing works.
+EGLContextInfo createEGLContext(int version=2);
+
+// Same as above, but always use |path|.
+EGLContextInfo createEGLContext(int version, EGLPath path);
+
+void destroyEGLContext(const EGLContextInfo& info);
+
+#endif /* end of include guard: EGL_CONTEXT_H */
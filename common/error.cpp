@@ -16,7 +16,11 @@
 
 #include <string.h>
 #include <iostream>
+#ifdef USE_GLES
+#include <GLES3/gl3.h>
+#else
 #include <GL/glu.h>
+#endif
 
 void printGlErrors_(const char* where, const int line) {
     GLenum error = GL_NO_ERROR;
@@ -26,7 +30,12 @@ void printGlErrors_(const char* where, const int line) {
             std::cerr << "[ERROR] OpenGL ";
             if (strlen(where) > 0)
                 std::cerr << "(" << where << ":" << line << ") ";
+#ifdef USE_GLES
+            // there is no GLU for ES
+            std::cerr << "0x" << std::hex << error << std::dec << std::endl;
+#else
             std::cerr << gluErrorString(error) << std::endl;
+#endif
         }
     } while (error != GL_NO_ERROR);
 }
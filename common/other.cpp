@@ -14,9 +14,12 @@
 
 #include "other.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <GL/glew.h>
-#include <GL/gl.h>
+#include <sstream>
 #include "error.h"
 #include "io.h"
 
@@ -24,7 +27,11 @@
 #ifndef SHADERS_DIR
 #define SHADERS_DIR "./"
 #endif
+#ifndef SPIRV_DIR
+#define SPIRV_DIR "./"
+#endif
 
+#ifndef USE_GLES
 void initGlew() {
     glewExperimental = GL_TRUE;
     GLenum err = glewInit();
@@ -41,29 +48,143 @@ void initGlew() {
         throw Exception("glewInit failed");
     }
 }
+#endif
+
+namespace {
+
+GLenum glShaderType(ShaderType type) {
+    if (type == ShaderType::fragment) return GL_FRAGMENT_SHADER;
+#ifndef USE_GLES
+    if (type == ShaderType::compute) return GL_COMPUTE_SHADER;
+#endif
+    return GL_VERTEX_SHADER;
+}
+
+#ifdef USE_GLES
+// The shaders are written in GLSL 1.50, which differs from GLSL ES 3.00
+// mostly in the precision qualifiers. Default to highp like desktop GL, the
+// shaders lower it where it is good enough.
+const char* const ES_HEADER =
+    "#version 300 es\n"
+    "precision highp float;\n"
+    "precision highp int;\n"
+    "precision highp sampler2D;\n"
+    "precision highp usampler2D;\n";
+#endif
+
+#ifndef USE_GLES
+// shaders/fshader.glsl is built to spirv/fshader.spv
+std::string spirvPath(const std::string& filepath) {
+    return SPIRV_DIR + filepath.substr(0, filepath.rfind('.')) + ".spv";
+}
+#endif
+
+} // namespace
+
+void printInfoLog(GLuint object) {
+    GLint length;
+    std::vector<char> buffer;
+    if (glIsShader(object)) {
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+        buffer.resize(std::max(length, 1));
+        glGetShaderInfoLog(object, buffer.size(), NULL, buffer.data());
+    } else {
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+        buffer.resize(std::max(length, 1));
+        glGetProgramInfoLog(object, buffer.size(), NULL, buffer.data());
+    }
+    std::cerr << buffer.data();
+}
+
+std::string defineConstants(const std::string& source,
+                            const std::vector<ShaderConstant>& constants) {
+    if (constants.empty()) return source;
+    std::ostringstream defines;
+    // enough digits to round trip, and a point to keep floats floats
+    defines << std::setprecision(9);
+    for (const auto& constant : constants) {
+        defines << "#define " << constant.name << " ";
+        if (constant.integer)
+            defines << int(constant.value) << "\n";
+        else
+            defines << std::showpoint << constant.value << std::noshowpoint
+                    << "\n";
+    }
+    std::string result = source;
+    result.insert(result.find('\n') + 1, defines.str());
+    return result;
+}
 
-GLuint compileShader(const std::string& filepath, ShaderType type) {
+GLuint compileShader(const std::string& filepath, ShaderType type,
+                     const std::vector<ShaderConstant>& constants) {
     std::string source = readFile(SHADERS_DIR + filepath);
     if (source.length() == 0)
       throw Exception("empty shader file");
-    auto gl_type = GL_VERTEX_SHADER;
-    if (type != ShaderType::vertex) gl_type = GL_FRAGMENT_SHADER;
+#ifdef USE_GLES
+    source.replace(0, source.find('\n') + 1, ES_HEADER);
+#endif
+    source = defineConstants(source, constants);
 
-    GLuint shader = glCreateShader(gl_type);
+    GLuint shader = glCreateShader(glShaderType(type));
     const char* source_c = source.c_str();
     glShaderSource(shader, 1, &source_c, NULL);
     glCompileShader(shader);
     GLint status;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
     if (status != GL_TRUE) {
-        std::cerr << "Failed to compile shader:\n";
+        std::cerr << "Failed to compile shader " << filepath << ":\n";
         std::cerr << source << std::endl;
         std::cerr << "************************************\n";
-        char buffer[512];
-        glGetShaderInfoLog(shader, 512, NULL, buffer);
-        std::cerr << buffer;
+        printInfoLog(shader);
         throw Exception();
     }
     printGlErrors();
     return shader;
 }
+
+#ifndef USE_GLES
+bool spirvAvailable(const std::string& filepath) {
+    if (!GLEW_ARB_gl_spirv) return false;
+    std::ifstream file(spirvPath(filepath));
+    return file.is_open();
+}
+
+GLuint loadSpirvShader(const std::string& filepath, ShaderType type,
+                       const std::vector<ShaderConstant>& constants) {
+    std::ifstream file(spirvPath(filepath), std::ios::binary);
+    std::string binary((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+    if (binary.empty())
+        throw Exception("Unable to read " + spirvPath(filepath));
+
+    std::vector<GLuint> ids, values;
+    for (const auto& constant : constants) {
+        // the values are passed as raw 32 bit words
+        GLuint value;
+        if (constant.integer) {
+            value = GLint(constant.value);
+        } else {
+            static_assert(sizeof(float) == sizeof(GLuint), "32 bit floats");
+            memcpy(&value, &constant.value, sizeof(value));
+        }
+        ids.push_back(constant.id);
+        values.push_back(value);
+    }
+
+    GLuint shader = glCreateShader(glShaderType(type));
+    glShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V_ARB,
+                   binary.data(), binary.size());
+    glSpecializeShaderARB(shader, "main", ids.size(), ids.data(),
+                          values.data());
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        std::cerr << "Failed to specialize shader " << spirvPath(filepath)
+                  << ":\n";
+        printInfoLog(shader);
+        throw Exception();
+    }
+    printGlErrors();
+    return shader;
+}
+#endif
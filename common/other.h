@@ -16,16 +16,67 @@
 #define OTHER_H
 
 #include <iostream>
+#include <string>
+#include <vector>
+// Programs on OpenGL ES build the common code with USE_GLES defined, which
+// leaves out everything needing GLEW, see volumetric_gles/CMakeLists.txt.
+#ifdef USE_GLES
+#include <GLES3/gl3.h>
+#else
 #include <GL/glew.h>
 #include <GL/gl.h>
+#endif
 
-enum class ShaderType {vertex, fragment};
+enum class ShaderType {vertex, fragment, compute};
 
+/**
+ * A tuning knob of a shader, a specialization constant in its SPIR-V build
+ * and a macro in its GLSL source.
+ */
+struct ShaderConstant {
+    std::string name;   // macro name
+    GLuint id;          // layout(constant_id)
+    float value;
+    bool integer;       // int constant, float otherwise
+};
+
+#ifndef USE_GLES
 void initGlew();
+#endif
+
+/**
+ * Print the whole info log of |object|, a shader or a program, to stderr.
+ */
+void printInfoLog(GLuint object);
+
+/**
+ * Return |source| with a #define for each of |constants| inserted after its
+ * #version line.
+ */
+std::string defineConstants(const std::string& source,
+                            const std::vector<ShaderConstant>& constants);
+
+/**
+ * Read |filepath|, define |constants| in it (see defineConstants), compile it
+ * as a shader and return its ID. With USE_GLES, the #version line of the
+ * desktop GLSL source is replaced by GLSL ES 3.00 with highp defaults.
+ */
+GLuint compileShader(const std::string& filepath, ShaderType type,
+                     const std::vector<ShaderConstant>& constants = {});
+
+#ifndef USE_GLES
+/**
+ * Whether the driver loads SPIR-V shaders and the build compiled |filepath|
+ * to SPIR-V, see cmake/shaders.cmake.
+ */
+bool spirvAvailable(const std::string& filepath);
 
 /**
- * Read |filepath|, compile it as a shader and return its ID.
+ * Load the SPIR-V build of |filepath|, specialize it with |constants| and
+ * return its ID.
  */
-GLuint compileShader(const std::string& filepath, ShaderType type);
+GLuint loadSpirvShader(const std::string& filepath, ShaderType type,
+                       const std::vector<ShaderConstant>& constants = {});
+#endif
 
 #endif /* end of include guard: OTHER_H */
@@ -0,0 +1,218 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reload.h"
+
+#include <algorithm>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "error.h"
+#include "io.h"
+
+// should be defined in CMakeLists.txt
+#ifndef SHADERS_DIR
+#define SHADERS_DIR "./"
+#endif
+
+// from GL_ARB_parallel_shader_compile, same value as the KHR one
+#ifndef GL_COMPLETION_STATUS_ARB
+#define GL_COMPLETION_STATUS_ARB 0x91B1
+#endif
+
+namespace {
+
+double millisecondsBetween(std::chrono::steady_clock::time_point start,
+                           std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void printShaderLog(GLuint shader, const std::string& name) {
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_TRUE) return;
+    std::cerr << "Failed to compile shader " << name << ":\n";
+    printInfoLog(shader);
+}
+
+}  // namespace
+
+ShaderReloader::ShaderReloader(GLuint program, const std::string& vshader,
+                               const std::string& fshader)
+    : program_(program), vshader_(vshader), fshader_(fshader),
+      running_(true) {
+    parallel_ = glewIsSupported("GL_ARB_parallel_shader_compile") ||
+                glewIsSupported("GL_KHR_parallel_shader_compile");
+    if (!parallel_)
+        std::cerr << "[WARNING] no parallel shader compile extension, "
+                     "shader reloads will stall the frame" << std::endl;
+
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0)
+        throw Exception("inotify_init1 failed");
+    // Watch the directory rather than the files, editors often save by
+    // writing a new file and renaming it over the old one.
+    if (inotify_add_watch(fd_, SHADERS_DIR, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(fd_);
+        throw Exception("Unable to watch " SHADERS_DIR);
+    }
+    watcher_ = std::thread(&ShaderReloader::watch, this);
+}
+
+ShaderReloader::~ShaderReloader() {
+    running_ = false;
+    watcher_.join();
+    close(fd_);
+    if (new_program_) {
+        glDeleteShader(new_vshader_);
+        glDeleteShader(new_fshader_);
+        glDeleteProgram(new_program_);
+    }
+}
+
+void ShaderReloader::bindAttribLocation(GLuint index, const std::string& name) {
+    attribs_.push_back(std::make_pair(index, name));
+}
+
+void ShaderReloader::setConstants(ShaderType type,
+                                  const std::vector<ShaderConstant>& constants) {
+    if (type == ShaderType::fragment)
+        fconstants_ = constants;
+    else
+        vconstants_ = constants;
+}
+
+void ShaderReloader::watch() {
+    alignas(inotify_event) char buffer[4096];
+    while (running_) {
+        // wake up regularly to notice |running_| going false
+        pollfd pfd = {fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        ssize_t length = read(fd_, buffer, sizeof(buffer));
+        bool changed = false;
+        for (ssize_t i = 0; i < length; ) {
+            auto event = reinterpret_cast<const inotify_event*>(buffer + i);
+            if (event->len > 0 &&
+                    (vshader_ == event->name || fshader_ == event->name))
+                changed = true;
+            i += sizeof(inotify_event) + event->len;
+        }
+        if (!changed) continue;
+
+        auto changed_at = Clock::now();
+        std::string vsource, fsource;
+        try {
+            vsource = readFile(SHADERS_DIR + vshader_);
+            fsource = readFile(SHADERS_DIR + fshader_);
+        } catch (const Exception&) {
+            continue; // probably caught in the middle of a save
+        }
+        if (vsource.empty() || fsource.empty()) continue;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!has_sources_) changed_at_ = changed_at;
+        vsource_.swap(vsource);
+        fsource_.swap(fsource);
+        has_sources_ = true;
+    }
+}
+
+GLuint ShaderReloader::update() {
+    auto now = Clock::now();
+    if (new_program_)
+        longest_frame_ms_ = std::max(longest_frame_ms_,
+                                     millisecondsBetween(last_update_, now));
+    last_update_ = now;
+
+    if (!new_program_) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!has_sources_) return program_;
+        }
+        startBuild();
+    }
+    if (parallel_) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(new_program_, GL_COMPLETION_STATUS_ARB, &done);
+        if (done != GL_TRUE) return program_;
+    }
+    finishBuild();
+    return program_;
+}
+
+void ShaderReloader::startBuild() {
+    auto start = Clock::now();
+    std::string vsource, fsource;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        vsource.swap(vsource_);
+        fsource.swap(fsource_);
+        build_changed_at_ = changed_at_;
+        has_sources_ = false;
+    }
+    vsource = defineConstants(vsource, vconstants_);
+    fsource = defineConstants(fsource, fconstants_);
+    const char* vsource_c = vsource.c_str();
+    const char* fsource_c = fsource.c_str();
+    new_vshader_ = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(new_vshader_, 1, &vsource_c, NULL);
+    glCompileShader(new_vshader_);
+    new_fshader_ = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(new_fshader_, 1, &fsource_c, NULL);
+    glCompileShader(new_fshader_);
+
+    // Don't query the compile status here, that would wait for the compiler.
+    // Linking fails anyway if any of the shaders didn't compile.
+    new_program_ = glCreateProgram();
+    glAttachShader(new_program_, new_vshader_);
+    glAttachShader(new_program_, new_fshader_);
+    for (const auto& attrib : attribs_)
+        glBindAttribLocation(new_program_, attrib.first, attrib.second.c_str());
+    glLinkProgram(new_program_);
+    printGlErrors();
+    longest_frame_ms_ = 0;
+    stall_ms_ = millisecondsBetween(start, Clock::now());
+}
+
+void ShaderReloader::finishBuild() {
+    auto start = Clock::now();
+    GLint status;
+    glGetProgramiv(new_program_, GL_LINK_STATUS, &status);
+    if (status == GL_TRUE) {
+        glUseProgram(new_program_);
+        glDeleteProgram(program_);
+        program_ = new_program_;
+    } else {
+        printShaderLog(new_vshader_, vshader_);
+        printShaderLog(new_fshader_, fshader_);
+        printInfoLog(new_program_);
+        glDeleteProgram(new_program_);
+    }
+    // the program keeps the shaders alive as long as it needs them
+    glDeleteShader(new_vshader_);
+    glDeleteShader(new_fshader_);
+    new_program_ = new_vshader_ = new_fshader_ = 0;
+    printGlErrors();
+
+    auto end = Clock::now();
+    stall_ms_ += millisecondsBetween(start, end);
+    std::ostream& out = status == GL_TRUE ? std::cout : std::cerr;
+    out << (status == GL_TRUE ? "[RELOAD] "
+                              : "[ERROR] Reload failed, keeping old program. ")
+        << "Latency " << millisecondsBetween(build_changed_at_, end)
+        << " ms, blocked the GL thread for " << stall_ms_
+        << " ms, longest frame while building " << longest_frame_ms_
+        << " ms" << std::endl;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Shader hot-reload. A background thread watches SHADERS_DIR with inotify and
+// reads the sources when they change, the GL thread then rebuilds the program
+// without waiting for the driver (if GL_ARB_parallel_shader_compile is there)
+// and swaps it in only once it has linked.
+
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "other.h"
+
+class ShaderReloader
+{
+public:
+    // |program| is the currently used program, built from |vshader| and
+    // |fshader| (file names relative to SHADERS_DIR).
+    ShaderReloader(GLuint program, const std::string& vshader,
+                   const std::string& fshader);
+    ~ShaderReloader();
+
+    // Bind the attribute |name| to |index| in every rebuilt program, so that
+    // the existing VAOs keep working after a swap.
+    void bindAttribLocation(GLuint index, const std::string& name);
+
+    // Define |constants| in the rebuilt vertex or fragment shader, the same
+    // way as compileShader() does, so that the knobs survive a reload.
+    void setConstants(ShaderType type,
+                      const std::vector<ShaderConstant>& constants);
+
+    // Call once per frame from the GL thread. Starts or continues a rebuild
+    // and returns the program which is in use after the call.
+    GLuint update();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    ShaderReloader(const ShaderReloader&) = delete;
+    ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+    // Body of the watcher thread.
+    void watch();
+    void startBuild();
+    void finishBuild();
+
+    GLuint program_;
+    const std::string vshader_;
+    const std::string fshader_;
+    std::vector<std::pair<GLuint, std::string>> attribs_;
+    std::vector<ShaderConstant> vconstants_;
+    std::vector<ShaderConstant> fconstants_;
+    bool parallel_;
+
+    // Shared with the watcher thread, guarded by |mutex_|.
+    std::mutex mutex_;
+    bool has_sources_ = false;
+    std::string vsource_;
+    std::string fsource_;
+    Clock::time_point changed_at_;
+
+    int fd_ = -1;
+    std::atomic<bool> running_;
+    std::thread watcher_;
+
+    // State of the rebuild in progress, only touched by the GL thread.
+    GLuint new_program_ = 0;
+    GLuint new_vshader_ = 0;
+    GLuint new_fshader_ = 0;
+    Clock::time_point build_changed_at_;
+    Clock::time_point last_update_;
+    double longest_frame_ms_ = 0;
+    double stall_ms_ = 0;
+};
+
+#endif /* end of include guard: RELOAD_H */
@@ -0,0 +1,26 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Telemetry helpers for the SDL examples, kept apart from telemetry.h so that
+// the programs without SDL don't need it.
+
+#ifndef SDL_TELEMETRY_H
+#define SDL_TELEMETRY_H
+
+#include <SDL.h>
+
+// Refresh rate in Hz of the display showing |window|, 0 if unknown.
+int refreshRate(SDL_Window *window);
+
+#endif /* end of include guard: SDL_TELEMETRY_H */
@@ -0,0 +1,161 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "telemetry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+// Histogram of durations with 50 us buckets up to 200 ms, longer durations
+// end up in the last bucket.
+class Histogram
+{
+public:
+    Histogram() : buckets_(4000, 0) {}
+
+    void add(double ms) {
+        size_t bucket = std::min(static_cast<size_t>(ms / BUCKET_MS),
+                                 buckets_.size() - 1);
+        buckets_[bucket]++;
+        count_++;
+        sum_ += ms;
+        max_ = std::max(max_, ms);
+    }
+
+    // Upper bound of the bucket containing the |p|-th percentile.
+    double percentile(double p) const {
+        uint64_t target = std::ceil(count_ * p / 100.0);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets_.size(); i++) {
+            seen += buckets_[i];
+            if (seen >= target && seen > 0)
+                return std::min((i + 1) * BUCKET_MS, max_);
+        }
+        return 0;
+    }
+
+    void writeJson(std::ostream& out) const {
+        out << "{\"mean_ms\": " << (count_ ? sum_ / count_ : 0)
+            << ", \"p50_ms\": " << percentile(50)
+            << ", \"p99_ms\": " << percentile(99)
+            << ", \"max_ms\": " << max_ << "}";
+    }
+
+private:
+    static constexpr double BUCKET_MS = 0.05;
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    double sum_ = 0;
+    double max_ = 0;
+};
+
+constexpr double Histogram::BUCKET_MS;
+
+double milliseconds(int64_t from, int64_t to) {
+    return (to - from) / 1e6;
+}
+
+}  // namespace
+
+FrameTelemetry::FrameTelemetry(int refresh_rate)
+    : path_(getenv("FRAME_TELEMETRY_JSON") ? getenv("FRAME_TELEMETRY_JSON")
+                                           : ""),
+      vsync_ms_(1000.0 / (refresh_rate > 0 ? refresh_rate : 60)) {
+    if (!path_.empty())
+        collector_ = std::thread(&FrameTelemetry::collect, this);
+}
+
+FrameTelemetry::~FrameTelemetry() {
+    if (!collector_.joinable()) return;
+    running_ = false;
+    collector_.join();
+}
+
+void FrameTelemetry::collect() {
+    Histogram frame, events, paint, swap;
+    uint64_t frames = 0, missed_vsyncs = 0;
+    double jitter_sum = 0;
+    int64_t previous_start = 0;
+    double previous_interval = -1;
+
+    auto last_dump = std::chrono::steady_clock::now();
+    bool stopping = false;
+    while (!stopping) {
+        // Read |running_| before draining, so that the frames pushed before
+        // the destructor ran are still part of the final dump.
+        stopping = !running_;
+        FrameTimestamps t;
+        while (ring_.pop(t)) {
+            frames++;
+            events.add(milliseconds(t.start, t.events));
+            paint.add(milliseconds(t.events, t.paint));
+            swap.add(milliseconds(t.paint, t.swap));
+            if (previous_start != 0) {
+                double interval = milliseconds(previous_start, t.start);
+                frame.add(interval);
+                // a frame covering n vsync periods (rounded) means that
+                // n - 1 vsyncs came without a new frame
+                missed_vsyncs += std::max(
+                    std::floor(interval / vsync_ms_ + 0.5) - 1, 0.0);
+                if (previous_interval >= 0)
+                    jitter_sum += std::fabs(interval - previous_interval);
+                previous_interval = interval;
+            }
+            previous_start = t.start;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (!stopping && now - last_dump < std::chrono::seconds(1)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+        last_dump = now;
+
+        // write a temporary file and rename it, so that readers never see a
+        // half written one
+        std::string tmp_path = path_ + ".tmp";
+        {
+            std::ofstream out(tmp_path);
+            if (!out.is_open()) {
+                std::cerr << "Unable to open file " << tmp_path << std::endl;
+                continue;
+            }
+            uint64_t intervals = frames > 2 ? frames - 2 : 0;
+            out << "{\n  \"frames\": " << frames
+                << ",\n  \"dropped_samples\": " << dropped_.load()
+                << ",\n  \"vsync_ms\": " << vsync_ms_
+                << ",\n  \"missed_vsyncs\": " << missed_vsyncs
+                << ",\n  \"jitter_ms\": "
+                << (intervals ? jitter_sum / intervals : 0)
+                << ",\n  \"frame\": ";
+            frame.writeJson(out);
+            out << ",\n  \"events\": ";
+            events.writeJson(out);
+            out << ",\n  \"paint\": ";
+            paint.writeJson(out);
+            out << ",\n  \"swap\": ";
+            swap.writeJson(out);
+            out << "\n}\n";
+        }
+        if (rename(tmp_path.c_str(), path_.c_str()) != 0)
+            std::cerr << "Unable to write " << path_ << std::endl;
+    }
+}
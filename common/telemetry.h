@@ -0,0 +1,111 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// CPU frame pacing telemetry. The render thread records a timestamp after each
+// stage of a frame into a lock-free ring, a collector thread aggregates them
+// and periodically dumps frame time statistics as JSON.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Single producer, single consumer ring of |Size| elements (a power of two).
+// Neither side ever blocks, push() fails when the ring is full.
+template <typename T, size_t Size>
+class SpscRing
+{
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+public:
+    bool push(const T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == Size)
+            return false;
+        buffer_[head & (Size - 1)] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire))
+            return false;
+        value = buffer_[tail & (Size - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // separate cache lines, so that the two threads don't fight over them
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    T buffer_[Size];
+};
+
+// Timestamps in nanoseconds of the steady clock, taken at the start of the
+// frame and after each of its stages.
+struct FrameTimestamps {
+    int64_t start;
+    int64_t events;
+    int64_t paint;
+    int64_t swap;
+};
+
+class FrameTelemetry
+{
+public:
+    // |refresh_rate| of the display in Hz, used for counting missed vsyncs.
+    // The statistics are written to the file in the FRAME_TELEMETRY_JSON
+    // environment variable. Without it nothing is collected.
+    explicit FrameTelemetry(int refresh_rate=60);
+    ~FrameTelemetry();
+
+    // Call from the render thread, in this order, once per frame.
+    void startFrame() { frame_.start = now(); }
+    void eventsDone() { frame_.events = now(); }
+    void paintDone() { frame_.paint = now(); }
+    void swapDone() {
+        if (path_.empty()) return;
+        frame_.swap = now();
+        if (!ring_.push(frame_))
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    FrameTelemetry(const FrameTelemetry&) = delete;
+    FrameTelemetry& operator=(const FrameTelemetry&) = delete;
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Body of the collector thread.
+    void collect();
+
+    FrameTimestamps frame_;
+    SpscRing<FrameTimestamps, 1024> ring_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> running_{true};
+    const std::string path_;
+    const double vsync_ms_;
+    std::thread collector_;
+};
+
+#endif /* end of include guard: TELEMETRY_H */
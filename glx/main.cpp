@@ -17,11 +17,19 @@
 // Create context using the low level GLX, similarly to how Chromium gets the
 // context (might have already changed). Create small window, show some colors
 // and close it after a couple of seconds.
+// With --upload-bench, upload big textures and buffers while drawing instead,
+// once on the main thread and once through a pool of shared contexts, and
+// print how long the main thread was blocked. Works under Xvfb, e.g.:
+//     LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ./bin/glx --upload-bench
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <GL/glew.h>
@@ -30,6 +38,7 @@
 
 #include "common/other.h"
 #include "common/error.h"
+#include "upload_pool.h"
 
 #define GLX_CONTEXT_MAJOR_VERSION_ARB 0x2091
 #define GLX_CONTEXT_MINOR_VERSION_ARB 0x2092
@@ -130,7 +139,84 @@ GLXContext createContext(Display* display, GLXFBConfig bestFbc) {
     return context;
 }
 
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Request a 16 MB texture or buffer upload every other frame, either done
+// directly on the main thread or by |pool|, and draw frames until all of them
+// are usable on the main thread. Frames are paced to 60 Hz, Xvfb has no vsync
+// and a spinning loop would both count frames and starve the workers.
+void benchmarkUploads(Display* display, Window win, UploadPool* pool) {
+    const int size = 2048, uploads = 16;
+    const auto frame_period = std::chrono::microseconds(16667);
+    auto data = std::make_shared<const std::vector<unsigned char>>(
+        size * size * 4, 0x80);
+    int requested = 0, finished = 0, frames = 0;
+    double stall_ms = 0, worst_frame_ms = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (finished < uploads) {
+        auto frame_start = std::chrono::steady_clock::now();
+        if (requested < uploads && frames % 2 == 0) {
+            bool texture = requested % 2 == 0;
+            if (pool && texture) {
+                pool->uploadTexture(size, size, data);
+            } else if (pool) {
+                pool->uploadBuffer(data);
+            } else {
+                GLuint object;
+                if (texture) {
+                    glGenTextures(1, &object);
+                    glBindTexture(GL_TEXTURE_2D, object);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0,
+                                 GL_RGBA, GL_UNSIGNED_BYTE, data->data());
+                    glDeleteTextures(1, &object);
+                } else {
+                    glGenBuffers(1, &object);
+                    glBindBuffer(GL_ARRAY_BUFFER, object);
+                    glBufferData(GL_ARRAY_BUFFER, data->size(), data->data(),
+                                 GL_STATIC_DRAW);
+                    glDeleteBuffers(1, &object);
+                }
+                finished++;
+            }
+            requested++;
+        }
+        if (pool) {
+            for (const auto& upload : pool->poll()) {
+                // this is where a real program would start using it
+                if (upload.target == GL_TEXTURE_2D) {
+                    glBindTexture(GL_TEXTURE_2D, upload.object);
+                    glDeleteTextures(1, &upload.object);
+                } else {
+                    glBindBuffer(GL_ARRAY_BUFFER, upload.object);
+                    glDeleteBuffers(1, &upload.object);
+                }
+                finished++;
+            }
+        }
+        stall_ms += millisecondsSince(frame_start);
+
+        glClearColor(frames % 2, 0.5, 1, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glXSwapBuffers(display, win);
+        frames++;
+        worst_frame_ms = std::max(worst_frame_ms,
+                                  millisecondsSince(frame_start));
+        std::this_thread::sleep_until(frame_start + frame_period);
+    }
+    printGlErrors();
+    printf("[BENCH] %s: %d uploads of %d MB in %d frames, %.1f ms total, "
+           "main thread blocked %.1f ms, worst frame %.1f ms\n",
+           pool ? "upload pool" : "main thread", uploads,
+           size * size * 4 / (1024 * 1024), frames, millisecondsSince(start),
+           stall_ms, worst_frame_ms);
+}
+
 int main(int argc, char* argv[]) {
+    // needed by the upload pool, whose contexts are used on other threads
+    XInitThreads();
     Display *display = XOpenDisplay(NULL);
     if (!display)
         fail("Failed to open X display\n");
@@ -170,18 +256,24 @@ int main(int argc, char* argv[]) {
     glXMakeCurrent(display, win, context);
     initGlew();
 
-    glClearColor(0, 0.5, 1, 1);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glXSwapBuffers(display, win);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (argc > 1 && strcmp(argv[1], "--upload-bench") == 0) {
+        benchmarkUploads(display, win, nullptr);
+        UploadPool pool(display, context, 2);
+        benchmarkUploads(display, win, &pool);
+    } else {
+        glClearColor(0, 0.5, 1, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glXSwapBuffers(display, win);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    sleep(1);
+        sleep(1);
 
-    glClearColor(1, 0.5, 0, 1);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glXSwapBuffers(display, win);
+        glClearColor(1, 0.5, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glXSwapBuffers(display, win);
 
-    sleep(1);
+        sleep(1);
+    }
 
     glXMakeCurrent(display, 0, 0);
     glXDestroyContext(display, context);
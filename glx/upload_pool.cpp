@@ -0,0 +1,190 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "upload_pool.h"
+
+#include <stdio.h>
+
+#include "common/error.h"
+
+#ifndef GLX_CONTEXT_MAJOR_VERSION_ARB
+#define GLX_CONTEXT_MAJOR_VERSION_ARB 0x2091
+#define GLX_CONTEXT_MINOR_VERSION_ARB 0x2092
+#endif
+
+typedef GLXContext (*glXCreateContextAttribsARBProc)
+    (Display*, GLXFBConfig, GLXContext, Bool, const int*);
+
+// The workers never draw, they only need something to make their context
+// current with.
+const int pbuffer_visual_attribs[] = {
+    GLX_DRAWABLE_TYPE   , GLX_PBUFFER_BIT,
+    GLX_RENDER_TYPE     , GLX_RGBA_BIT,
+    GLX_RED_SIZE        , 8,
+    GLX_GREEN_SIZE      , 8,
+    GLX_BLUE_SIZE       , 8,
+    None
+};
+
+UploadPool::UploadPool(Display* display, GLXContext context, int threads)
+    : display_(display) {
+    if (!GLEW_ARB_sync)
+        fail("Upload pool needs GL_ARB_sync\n");
+    glXCreateContextAttribsARBProc glXCreateContextAttribsARB =
+        (glXCreateContextAttribsARBProc) glXGetProcAddressARB(
+            (const GLubyte *) "glXCreateContextAttribsARB");
+    int fbcount;
+    GLXFBConfig* fbc = glXChooseFBConfig(display, DefaultScreen(display),
+                                         pbuffer_visual_attribs, &fbcount);
+    if (!fbc || fbcount == 0)
+        fail("Failed to retrieve a pbuffer framebuffer config\n");
+    const int pbuffer_attribs[] = {
+        GLX_PBUFFER_WIDTH, 1,
+        GLX_PBUFFER_HEIGHT, 1,
+        None
+    };
+    const int context_attribs[] = {
+        GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+        GLX_CONTEXT_MINOR_VERSION_ARB, 0,
+        None
+    };
+    // Create everything here, the X calls are cheaper to debug on one thread.
+    for (int i = 0; i < threads; i++) {
+        GLXContext shared = glXCreateContextAttribsARB(display, fbc[0],
+                            context, true, context_attribs);
+        XSync(display, false);
+        if (!shared)
+            fail("Failed to create shared GL 3.0 context\n");
+        contexts_.push_back(shared);
+        GLXPbuffer pbuffer = glXCreatePbuffer(display, fbc[0], pbuffer_attribs);
+        XSync(display, false);
+        if (!pbuffer)
+            fail("Failed to create pbuffer\n");
+        pbuffers_.push_back(pbuffer);
+    }
+    XFree(fbc);
+    for (int i = 0; i < threads; i++)
+        workers_.push_back(std::thread(&UploadPool::work, this, contexts_[i],
+                                       pbuffers_[i]));
+    printf("Created upload pool with %d shared contexts\n", threads);
+}
+
+UploadPool::~UploadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_)
+        worker.join();
+    // Objects nobody picked up yet still belong to the share group.
+    for (auto& pending : fenced_)
+        waiting_.push_back(pending);
+    for (auto& pending : waiting_) {
+        glDeleteSync(pending.fence);
+        if (pending.upload.target == GL_TEXTURE_2D)
+            glDeleteTextures(1, &pending.upload.object);
+        else
+            glDeleteBuffers(1, &pending.upload.object);
+    }
+    for (size_t i = 0; i < contexts_.size(); i++) {
+        glXDestroyContext(display_, contexts_[i]);
+        glXDestroyPbuffer(display_, pbuffers_[i]);
+    }
+}
+
+unsigned UploadPool::uploadTexture(GLsizei width, GLsizei height,
+                                   UploadData pixels) {
+    return queue(Job{0, GL_TEXTURE_2D, width, height, pixels});
+}
+
+unsigned UploadPool::uploadBuffer(UploadData data) {
+    return queue(Job{0, GL_ARRAY_BUFFER, 0, 0, data});
+}
+
+unsigned UploadPool::queue(const Job& job) {
+    unsigned id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+        jobs_.push_back(job);
+        jobs_.back().id = id;
+    }
+    cv_.notify_one();
+    return id;
+}
+
+std::vector<FinishedUpload> UploadPool::poll() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        waiting_.insert(waiting_.end(), fenced_.begin(), fenced_.end());
+        fenced_.clear();
+    }
+    std::vector<FinishedUpload> finished;
+    for (size_t i = 0; i < waiting_.size(); ) {
+        // zero timeout, only asks whether the worker's commands completed
+        GLenum status = glClientWaitSync(waiting_[i].fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED ||
+                status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(waiting_[i].fence);
+            finished.push_back(waiting_[i].upload);
+            waiting_.erase(waiting_.begin() + i);
+        } else {
+            if (status == GL_WAIT_FAILED) printGlErrors();
+            i++;
+        }
+    }
+    return finished;
+}
+
+void UploadPool::work(GLXContext context, GLXPbuffer pbuffer) {
+    if (!glXMakeContextCurrent(display_, pbuffer, pbuffer, context))
+        fail("Couldn't make upload context current\n");
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]{ return !running_ || !jobs_.empty(); });
+            if (!running_) break;
+            job = jobs_.front();
+            jobs_.pop_front();
+        }
+
+        GLuint object;
+        if (job.target == GL_TEXTURE_2D) {
+            glGenTextures(1, &object);
+            glBindTexture(GL_TEXTURE_2D, object);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, job.width, job.height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, job.data->data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+        } else {
+            glGenBuffers(1, &object);
+            glBindBuffer(GL_ARRAY_BUFFER, object);
+            glBufferData(GL_ARRAY_BUFFER, job.data->size(), job.data->data(),
+                         GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // without a flush the fence might never reach the GPU, and the main
+        // thread would wait forever
+        glFlush();
+        printGlErrors();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        fenced_.push_back(Pending{FinishedUpload{job.id, job.target, object},
+                                  fence});
+    }
+    glXMakeContextCurrent(display_, None, None, NULL);
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Pool of worker threads, each owning a GLX context which shares objects with
+// the main one. The workers upload textures and buffers and hand them over to
+// the main thread with a fence, so the main thread never waits for the copy.
+// XInitThreads() has to be called before opening the display.
+
+#ifndef UPLOAD_POOL_H
+#define UPLOAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <X11/Xlib.h>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+
+typedef std::shared_ptr<const std::vector<unsigned char>> UploadData;
+
+// An object which was uploaded by a worker and can be used by the main thread.
+struct FinishedUpload {
+    unsigned id;
+    GLenum target; // GL_TEXTURE_2D or GL_ARRAY_BUFFER
+    GLuint object;
+};
+
+class UploadPool
+{
+public:
+    // |context| has to be current on the calling thread.
+    UploadPool(Display* display, GLXContext context, int threads);
+    ~UploadPool();
+
+    // Queue an upload of RGBA pixels into a new texture, return its id.
+    unsigned uploadTexture(GLsizei width, GLsizei height, UploadData pixels);
+    // Queue an upload of |data| into a new buffer, return its id.
+    unsigned uploadBuffer(UploadData data);
+
+    // Return the uploads finished since the last call, never blocks. Call
+    // from the thread owning the main context.
+    std::vector<FinishedUpload> poll();
+
+private:
+    struct Job {
+        unsigned id;
+        GLenum target;
+        GLsizei width, height;
+        UploadData data;
+    };
+    struct Pending {
+        FinishedUpload upload;
+        GLsync fence;
+    };
+
+    UploadPool(const UploadPool&) = delete;
+    UploadPool& operator=(const UploadPool&) = delete;
+
+    unsigned queue(const Job& job);
+    // Body of the worker threads.
+    void work(GLXContext context, GLXPbuffer pbuffer);
+
+    Display* display_;
+    std::vector<GLXContext> contexts_;
+    std::vector<GLXPbuffer> pbuffers_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_ = true;
+    unsigned next_id_ = 0;
+    std::deque<Job> jobs_;
+    std::vector<Pending> fenced_; // uploaded, fence not yet checked
+
+    std::vector<Pending> waiting_; // only touched by the main thread
+};
+
+#endif /* end of include guard: UPLOAD_POOL_H */
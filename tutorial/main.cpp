@@ -22,6 +22,8 @@
 #include "common/error.h"
 #include "common/io.h"
 #include "common/other.h"
+#include "common/sdl_telemetry.h"
+#include "common/telemetry.h"
 
 
 const float vertices[] = {
@@ -101,16 +103,20 @@ int main(int argc, char *argv[]) {
     initGlew();
     auto program = initShaders();
     initBuffers(program);
-
-    paint();
+    FrameTelemetry telemetry(refreshRate(window));
 
     SDL_Event event;
     while (true) {
+        telemetry.startFrame();
         if (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) break;
             if (event.type == SDL_KEYDOWN) break;
         }
+        telemetry.eventsDone();
+        paint();
+        telemetry.paintDone();
         SDL_GL_SwapWindow(window);
+        telemetry.swapDone();
     }
 
     SDL_GL_DeleteContext(context);
@@ -0,0 +1,248 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The volumetric_rendering raymarcher on a headless OpenGL ES 3.0 context.
+// Renders the scene offscreen with highp and mediump variants of the distance
+// and lighting code, reports frame time and image error against the all-highp
+// image for each, and picks the fastest variant whose error stays below the
+// limits. Optionally writes the image of the picked variant:
+//     ./bin/volumetric_gles picked.ppm
+// The shaders are the ones of volumetric_rendering, compiled as GLSL ES 3.00
+// (see compileShader in common/other.h). Other options:
+//     --objects N        number of primitives in the scene, 4 by default
+//     --binning MODE     none or cpu (default), see binning.h
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+
+#include "common/egl_context.h"
+#include "common/error.h"
+#include "common/other.h"
+#include "volumetric_rendering/binning.h"
+#include "volumetric_rendering/camera_path.h"
+
+const int WIDTH = CANVAS_WIDTH;
+const int HEIGHT = CANVAS_HEIGHT;
+const int FRAMES = 20;
+// largest acceptable error of a channel, and of the whole image, in 0-255 units
+const double MAX_ERROR = 8;
+const double MAX_RMS_ERROR = 1;
+
+const float vertices[] = {
+    -1, -1,
+    1, -1,
+    1, 1,
+    -1, -1,
+    1, 1,
+    -1, 1,
+};
+
+struct Variant {
+    bool distance_mediump;
+    bool lighting_mediump;
+    double frame_ms;
+    double max_error;
+    double rms_error;
+};
+
+const char* precisionName(bool mediump) {
+    return mediump ? "mediump" : "highp";
+}
+
+GLuint initShaders(const Variant& variant) {
+    // see the precision macros in fshader.glsl
+    std::vector<ShaderConstant> precisions = {
+        {"DISTANCE_MEDIUMP", 0, float(variant.distance_mediump), true},
+        {"LIGHTING_MEDIUMP", 0, float(variant.lighting_mediump), true},
+    };
+    auto vshader = compileShader("vshader.glsl", ShaderType::vertex);
+    auto fshader = compileShader("fshader.glsl", ShaderType::fragment,
+                                 precisions);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vshader);
+    glAttachShader(program, fshader);
+    glBindAttribLocation(program, 0, "position");
+    glLinkProgram(program);
+    glDeleteShader(vshader);
+    glDeleteShader(fshader);
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        printInfoLog(program);
+        throw Exception("program linking failed");
+    }
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Scene"), 0);
+    return program;
+}
+
+/**
+ * Create the offscreen framebuffer, vertex and scene buffers and bind them.
+ */
+void initBuffers(const SceneUniforms& scene) {
+    GLuint texture, fbo;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, WIDTH, HEIGHT);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw Exception("incomplete framebuffer");
+    glViewport(0, 0, WIDTH, HEIGHT);
+
+    GLuint vbo, vao, ubo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), 0);
+
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(scene), &scene, GL_STATIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo);
+}
+
+// Draw FRAMES frames with |program|, return the average time of a frame in ms
+// and the pixels of the last one.
+double render(GLuint program, std::vector<GLubyte>* pixels) {
+    glUseProgram(program);
+    // the first frame might include some lazy compilation
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < FRAMES; i++) {
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glFinish();
+    }
+    auto end = std::chrono::steady_clock::now();
+    pixels->resize(WIDTH * HEIGHT * 4);
+    glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE,
+                 pixels->data());
+    return std::chrono::duration<double, std::milli>(end - start).count() /
+           FRAMES;
+}
+
+void compareImages(const std::vector<GLubyte>& reference,
+                   const std::vector<GLubyte>& pixels, Variant* variant) {
+    double max_error = 0, sum = 0;
+    for (size_t i = 0; i < pixels.size(); i++) {
+        double error = std::abs(pixels[i] - reference[i]);
+        max_error = std::max(max_error, error);
+        sum += error * error;
+    }
+    variant->max_error = max_error;
+    variant->rms_error = std::sqrt(sum / pixels.size());
+}
+
+void writePPM(const std::string& filepath, const std::vector<GLubyte>& pixels) {
+    FILE* f = fopen(filepath.c_str(), "wb");
+    if (!f) throw Exception("Unable to open " + filepath);
+    fprintf(f, "P6 %d %d 255\n", WIDTH, HEIGHT);
+    // GL rows go from the bottom up
+    for (int y = HEIGHT - 1; y >= 0; y--) {
+        for (int x = 0; x < WIDTH; x++)
+            fwrite(&pixels[(y * WIDTH + x) * 4], 1, 3, f);
+    }
+    fclose(f);
+}
+
+void printPrecision(GLenum precision, const char* name) {
+    GLint range[2], bits;
+    glGetShaderPrecisionFormat(GL_FRAGMENT_SHADER, precision, range, &bits);
+    printf("Fragment shader %s float: %d bits of precision, range 2^%d\n",
+           name, bits, range[1]);
+}
+
+int main(int argc, char *argv[]) {
+    int objects = 4;
+    auto binning = Binning::cpu;
+    std::string output;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--objects" && i + 1 < argc)
+            objects = atoi(argv[++i]);
+        else if (arg == "--binning" && i + 1 < argc)
+            binning = parseBinning(argv[++i]);
+        else
+            output = arg;
+    }
+
+    EGLContextInfo egl;
+    try {
+        egl = createEGLContext(3);
+    } catch (const Exception& e) {
+        fail("%s\n", e.what());
+    }
+    printf("GL_RENDERER = %s\n", glGetString(GL_RENDERER));
+    printPrecision(GL_HIGH_FLOAT, "highp");
+    printPrecision(GL_MEDIUM_FLOAT, "mediump");
+    auto scene = defaultScene();
+    initBuffers(scene);
+    std::unique_ptr<TileBinner> binner(new TileBinner(makeScene(objects),
+                                                      binning));
+    binner->update(scene);
+
+    // the first one is the reference
+    Variant variants[] = {
+        {false, false, 0, 0, 0},
+        {false, true, 0, 0, 0},
+        {true, false, 0, 0, 0},
+        {true, true, 0, 0, 0},
+    };
+    std::vector<GLubyte> reference, pixels, picked_pixels;
+    Variant* picked = nullptr;
+    printf("%-9s %-9s %10s %10s %10s\n", "distance", "lighting", "frame ms",
+           "max error", "rms error");
+    for (auto& variant : variants) {
+        GLuint program = initShaders(variant);
+        binner->setUniforms(program);
+        variant.frame_ms = render(program, &pixels);
+        // unbind it first, the next setUniforms() restores the current one
+        glUseProgram(0);
+        glDeleteProgram(program);
+        if (reference.empty()) reference = pixels;
+        compareImages(reference, pixels, &variant);
+        printf("%-9s %-9s %10.2f %10.0f %10.3f\n",
+               precisionName(variant.distance_mediump),
+               precisionName(variant.lighting_mediump), variant.frame_ms,
+               variant.max_error, variant.rms_error);
+
+        if (variant.max_error <= MAX_ERROR &&
+                variant.rms_error <= MAX_RMS_ERROR &&
+                (!picked || variant.frame_ms < picked->frame_ms)) {
+            picked = &variant;
+            picked_pixels = pixels;
+        }
+    }
+    // the reference always qualifies, its error is zero
+    printf("Picked distance %s, lighting %s\n",
+           precisionName(picked->distance_mediump),
+           precisionName(picked->lighting_mediump));
+    if (!output.empty()) writePPM(output, picked_pixels);
+
+    binner.reset(); // needs the context to delete its textures
+    destroyEGLContext(egl);
+    return 0;
+}
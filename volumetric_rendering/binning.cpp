@@ -0,0 +1,404 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "binning.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "common/error.h"
+#include "common/other.h"
+
+// Grow the bounds a bit, rays passing closer than EPSILON to a surface count
+// as hits and the normal estimation looks around the hit point too.
+const float BOUNDS_MARGIN = 0.01;
+
+// Texture units of the texture buffers, in the order of TileBinner::buffers_.
+// The SPIR-V build of fshader.glsl binds its samplers to them.
+const GLint TEXTURE_UNITS[] = {0, 1, 2};
+const char* const SAMPLER_NAMES[] = {"primitives", "tileCounts", "tileIndices"};
+
+// Work group size of cshader.glsl, in tiles.
+const int GROUP_SIZE = 8;
+
+// Binding point of the StepCounts block of fshader.glsl, after the three
+// buffers of cshader.glsl.
+const GLuint STEP_COUNTS_BINDING = 3;
+
+#ifdef USE_GLES
+// Width of the 2D textures standing in for texture buffers, see fshader.glsl.
+const GLsizei BUFFER_TEXTURE_WIDTH = 1024;
+#endif
+
+namespace {
+
+// Tile containing the |pixel| coordinate, clamped to -1 and |tiles| so that
+// huge bounds don't overflow.
+int tileOf(float pixel, int tiles) {
+    return std::max(-1.0f, std::min(float(tiles),
+                                    std::floor(pixel / TILE_SIZE)));
+}
+
+#ifdef USE_GLES
+// Rows of a BUFFER_TEXTURE_WIDTH wide texture holding |texels|.
+GLsizei textureRows(size_t texels) {
+    return std::max<GLsizei>(1, (texels + BUFFER_TEXTURE_WIDTH - 1) /
+                                BUFFER_TEXTURE_WIDTH);
+}
+#endif
+
+}  // namespace
+
+const char* binningName(Binning binning) {
+    switch (binning) {
+        case Binning::none:
+            return "none";
+        case Binning::cpu:
+            return "cpu";
+        case Binning::compute:
+            return "compute";
+    }
+    return "unknown";
+}
+
+Binning parseBinning(const std::string& name) {
+    for (auto binning : {Binning::none, Binning::cpu, Binning::compute}) {
+        if (name == binningName(binning)) return binning;
+    }
+    throw Exception("unknown binning " + name);
+}
+
+std::vector<Primitive> makeScene(int objects) {
+    std::vector<Primitive> primitives = {
+        {{0.1, 0, 0.3}, Primitive::sphere, {0.2, 0, 0}, 0},
+        {{-0.1, 0, 0.3}, Primitive::sphere, {0.2, 0, 0}, 0},
+        {{0, -0.15, 0.3}, Primitive::sphere, {0.2, 0, 0}, 0},
+        {{-0.4, -0.3, 0.2}, Primitive::box, {0.2, 0.3, 0.1}, 0},
+    };
+    int extra = objects - primitives.size();
+    if (extra <= 0) {
+        primitives.resize(std::max(objects, 0));
+        return primitives;
+    }
+    int side = std::ceil(std::sqrt(extra));
+    float spacing = 1.6 / side;
+    for (int i = 0; i < extra; i++) {
+        float x = -0.8 + spacing * (i % side + 0.5);
+        float y = -0.8 + spacing * (i / side + 0.5);
+        float size = spacing / 3;
+        if (i % 2 == 0)
+            primitives.push_back({{x, y, 0.8}, Primitive::sphere,
+                                  {size, 0, 0}, 0});
+        else
+            primitives.push_back({{x, y, 0.8}, Primitive::box,
+                                  {size, size, size}, 0});
+    }
+    return primitives;
+}
+
+bool projectBounds(const Primitive& primitive, const float camera[3],
+                   float bounds[4]) {
+    // Rays start on the z = 0 plane and go away from the camera, see
+    // raymarch() in fshader.glsl.
+    if (camera[2] >= 0) return false;
+    float half[3];
+    for (int i = 0; i < 3; i++) {
+        half[i] = (primitive.type == Primitive::sphere ? primitive.size[0]
+                                                       : primitive.size[i] / 2)
+                  + BOUNDS_MARGIN;
+    }
+    bounds[0] = bounds[1] = INFINITY;
+    bounds[2] = bounds[3] = -INFINITY;
+    // A perspective projection keeps lines straight, so the projected box
+    // lies within the projected corners.
+    for (int corner = 0; corner < 8; corner++) {
+        float p[3];
+        for (int i = 0; i < 3; i++) {
+            p[i] = primitive.center[i] + (corner & (1 << i) ? half[i]
+                                                             : -half[i]);
+        }
+        float depth = p[2] - camera[2];
+        if (depth <= 0) return false;
+        // where the ray from the camera through p crosses z = 0
+        float scale = -camera[2] / depth;
+        float x = (camera[0] + (p[0] - camera[0]) * scale) * CANVAS_WIDTH
+                  + CANVAS_WIDTH / 2;
+        float y = (camera[1] + (p[1] - camera[1]) * scale) * CANVAS_HEIGHT
+                  + CANVAS_HEIGHT / 2;
+        bounds[0] = std::min(bounds[0], x);
+        bounds[1] = std::min(bounds[1], y);
+        bounds[2] = std::max(bounds[2], x);
+        bounds[3] = std::max(bounds[3], y);
+    }
+    return true;
+}
+
+TileBinner::TileBinner(const std::vector<Primitive>& primitives,
+                       Binning binning)
+    : binning_(binning), primitives_(primitives),
+      primitive_count_(primitives.size()), counts_(TILES_X * TILES_Y),
+      indices_(counts_.size() * MAX_TILE_PRIMITIVES) {
+#ifdef USE_GLES
+    bool compute_supported = false;
+#else
+    bool compute_supported = GLEW_ARB_compute_shader &&
+                             GLEW_ARB_shader_storage_buffer_object;
+#endif
+    if (binning_ == Binning::compute && !compute_supported) {
+        std::cerr << "[WARNING] no compute shaders, binning on the CPU"
+                  << std::endl;
+        binning_ = Binning::cpu;
+    }
+    if (binning_ == Binning::compute) {
+        try {
+            auto cshader = compileShader("cshader.glsl", ShaderType::compute);
+            compute_program_ = glCreateProgram();
+            glAttachShader(compute_program_, cshader);
+            glLinkProgram(compute_program_);
+            glDeleteShader(cshader);
+            GLint status;
+            glGetProgramiv(compute_program_, GL_LINK_STATUS, &status);
+            if (status != GL_TRUE) {
+                glDeleteProgram(compute_program_);
+                compute_program_ = 0;
+                throw Exception("compute program linking failed");
+            }
+        } catch (const Exception&) {
+            std::cerr << "[WARNING] compute shader failed, binning on the CPU"
+                      << std::endl;
+            binning_ = Binning::cpu;
+        }
+    }
+
+    glGenTextures(3, textures_);
+#ifdef USE_GLES
+    // Pad everything to whole rows, so that each upload is one rectangle.
+    std::vector<Primitive> padded(primitives);
+    padded.resize(textureRows(2 * primitives.size()) *
+                  BUFFER_TEXTURE_WIDTH / 2);
+    counts_.resize(textureRows(counts_.size()) * BUFFER_TEXTURE_WIDTH);
+    indices_.resize(textureRows(indices_.size()) * BUFFER_TEXTURE_WIDTH);
+    const GLsizei rows[] = {
+        textureRows(2 * padded.size()),
+        textureRows(counts_.size()),
+        textureRows(indices_.size()),
+    };
+    const void* data[] = {padded.data(), counts_.data(), indices_.data()};
+    const GLenum formats[] = {GL_RGBA32F, GL_R32UI, GL_R32UI};
+    const GLenum pixel_formats[] = {GL_RGBA, GL_RED_INTEGER, GL_RED_INTEGER};
+    const GLenum types[] = {GL_FLOAT, GL_UNSIGNED_INT, GL_UNSIGNED_INT};
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNITS[i]);
+        glBindTexture(GL_TEXTURE_2D, textures_[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], BUFFER_TEXTURE_WIDTH,
+                       rows[i]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, BUFFER_TEXTURE_WIDTH, rows[i],
+                        pixel_formats[i], types[i], data[i]);
+        // integer textures can't be filtered, and are incomplete otherwise
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+#else
+    glGenBuffers(3, buffers_);
+    const GLsizeiptr sizes[] = {
+        GLsizeiptr(primitives.size() * sizeof(Primitive)),
+        GLsizeiptr(counts_.size() * sizeof(GLuint)),
+        GLsizeiptr(indices_.size() * sizeof(GLuint)),
+    };
+    const void* data[] = {primitives.data(), nullptr, nullptr};
+    const GLenum formats[] = {GL_RGBA32F, GL_R32UI, GL_R32UI};
+    for (int i = 0; i < 3; i++) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers_[i]);
+        // an empty scene still needs a buffer to point the texture at
+        glBufferData(GL_TEXTURE_BUFFER, std::max<GLsizeiptr>(sizes[i], 16),
+                     data[i], i == 0 ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNITS[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers_[i]);
+    }
+#endif
+    glActiveTexture(GL_TEXTURE0);
+    printGlErrors();
+}
+
+TileBinner::~TileBinner() {
+    glDeleteTextures(3, textures_);
+#ifndef USE_GLES
+    glDeleteBuffers(3, buffers_);
+#endif
+    if (compute_program_) glDeleteProgram(compute_program_);
+}
+
+void TileBinner::setUniforms(GLuint program, bool spirv) const {
+    GLint current;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    glUseProgram(program);
+    GLint count_location = PRIMITIVE_COUNT_LOCATION;
+    GLint binning_location = BINNING_LOCATION;
+    if (!spirv) {
+        for (int i = 0; i < 3; i++) {
+            glUniform1i(glGetUniformLocation(program, SAMPLER_NAMES[i]),
+                        TEXTURE_UNITS[i]);
+        }
+        count_location = glGetUniformLocation(program, "primitiveCount");
+        binning_location = glGetUniformLocation(program, "binning");
+    }
+    glUniform1i(count_location, primitive_count_);
+    glUniform1i(binning_location, binning_ != Binning::none);
+    glUseProgram(current);
+    printGlErrors();
+}
+
+void TileBinner::update(const SceneUniforms& scene) {
+    if (binning_ == Binning::none) return;
+#ifndef USE_GLES
+    if (binning_ == Binning::compute) {
+        GLint current;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        glUseProgram(compute_program_);
+        glUniform1i(glGetUniformLocation(compute_program_, "primitiveCount"),
+                    primitive_count_);
+        for (int i = 0; i < 3; i++)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffers_[i]);
+        glDispatchCompute((TILES_X + GROUP_SIZE - 1) / GROUP_SIZE,
+                          (TILES_Y + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+                        GL_BUFFER_UPDATE_BARRIER_BIT);
+        glUseProgram(current);
+        printGlErrors();
+        return;
+    }
+#endif
+
+    std::fill(counts_.begin(), counts_.end(), 0);
+    for (GLuint i = 0; i < primitives_.size(); i++) {
+        float bounds[4];
+        int x0 = 0, y0 = 0, x1 = TILES_X - 1, y1 = TILES_Y - 1;
+        if (projectBounds(primitives_[i], scene.camera, bounds)) {
+            x0 = std::max(tileOf(bounds[0], TILES_X), 0);
+            y0 = std::max(tileOf(bounds[1], TILES_Y), 0);
+            x1 = std::min(tileOf(bounds[2], TILES_X), TILES_X - 1);
+            y1 = std::min(tileOf(bounds[3], TILES_Y), TILES_Y - 1);
+        }
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                int tile = y * TILES_X + x;
+                GLuint& count = counts_[tile];
+                if (count == TILE_OVERFLOW) continue;
+                if (count == MAX_TILE_PRIMITIVES) {
+                    count = TILE_OVERFLOW;
+                    continue;
+                }
+                indices_[tile * MAX_TILE_PRIMITIVES + count++] = i;
+            }
+        }
+    }
+#ifdef USE_GLES
+    const std::vector<GLuint>* lists[] = {&counts_, &indices_};
+    for (int i = 1; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNITS[i]);
+        glBindTexture(GL_TEXTURE_2D, textures_[i]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, BUFFER_TEXTURE_WIDTH,
+                        textureRows(lists[i - 1]->size()), GL_RED_INTEGER,
+                        GL_UNSIGNED_INT, lists[i - 1]->data());
+    }
+    glActiveTexture(GL_TEXTURE0);
+#else
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers_[1]);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, counts_.size() * sizeof(GLuint),
+                    counts_.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers_[2]);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, indices_.size() * sizeof(GLuint),
+                    indices_.data());
+#endif
+    printGlErrors();
+}
+
+double TileBinner::estimatePrimitives() {
+    if (binning_ == Binning::none) return primitive_count_;
+#ifndef USE_GLES
+    if (binning_ == Binning::compute) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers_[1]);
+        glGetBufferSubData(GL_TEXTURE_BUFFER, 0,
+                           counts_.size() * sizeof(GLuint), counts_.data());
+    }
+#endif
+    double sum = 0;
+    int stepping_pixels = 0;
+    for (int y = 0; y < TILES_Y; y++) {
+        for (int x = 0; x < TILES_X; x++) {
+            GLuint count = counts_[y * TILES_X + x];
+            // pixels of empty tiles return before the first step
+            if (count == 0) continue;
+            // tiles at the edges might be cut off by the canvas
+            int pixels = (std::min(TILE_SIZE * (x + 1), CANVAS_WIDTH) -
+                          TILE_SIZE * x) *
+                         (std::min(TILE_SIZE * (y + 1), CANVAS_HEIGHT) -
+                          TILE_SIZE * y);
+            sum += pixels * (count == TILE_OVERFLOW ? primitive_count_ : count);
+            stepping_pixels += pixels;
+        }
+    }
+    return stepping_pixels ? sum / stepping_pixels : 0;
+}
+
+#ifndef USE_GLES
+StepCounter::StepCounter() {
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 2 * TILES_X * TILES_Y * sizeof(GLuint), nullptr,
+                 GL_DYNAMIC_READ);
+    printGlErrors();
+}
+
+StepCounter::~StepCounter() {
+    glDeleteBuffers(1, &buffer_);
+}
+
+bool StepCounter::supported() {
+    return GLEW_ARB_shader_storage_buffer_object;
+}
+
+void StepCounter::reset(GLuint program) {
+    std::vector<GLuint> zeros(2 * TILES_X * TILES_Y);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, zeros.size() * sizeof(GLuint),
+                    zeros.data());
+    glShaderStorageBlockBinding(
+        program,
+        glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK,
+                                  "StepCounts"),
+        STEP_COUNTS_BINDING);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STEP_COUNTS_BINDING, buffer_);
+    printGlErrors();
+}
+
+double StepCounter::averagePrimitives() {
+    std::vector<GLuint> counts(2 * TILES_X * TILES_Y);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer_);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                       counts.size() * sizeof(GLuint), counts.data());
+    printGlErrors();
+    // sum up in doubles, the counters of the whole canvas could overflow
+    double steps = 0, evaluations = 0;
+    for (size_t i = 0; i < counts.size(); i += 2) {
+        steps += counts[i];
+        evaluations += counts[i + 1];
+    }
+    return steps ? evaluations / steps : 0;
+}
+#endif
@@ -0,0 +1,145 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Screen space tile binning of the SDF primitives. The bounds of every
+// primitive are projected to the screen and each 32x32 pixel tile gets a list
+// of the primitives which might be visible in it, so that the fragment shader
+// only evaluates those. The lists are built either on the CPU or with a
+// compute shader, and passed to the fragment shader in texture buffers, or
+// in 2D textures on OpenGL ES 3.0 (CPU binning only).
+//
+// Skipping the other primitives makes the rays take longer steps, so they stop
+// at slightly different points within EPSILON of the surface. That doesn't
+// show on flat and round surfaces, but the normal estimated right at a box
+// edge depends on which side of the edge the ray stopped. Binned images thus
+// differ from unbinned ones on some edge pixels, which is accepted; evaluating
+// all primitives close to the surface doesn't avoid it, the steps before
+// already differ.
+
+#ifndef BINNING_H
+#define BINNING_H
+
+#include <string>
+#include <vector>
+
+#include "common/other.h" // GL or GLES headers
+#include "camera_path.h"
+
+// Keep these in sync with fshader.glsl and cshader.glsl.
+const int CANVAS_WIDTH = 800;
+const int CANVAS_HEIGHT = 800;
+const int TILE_SIZE = 32;
+const int TILES_X = (CANVAS_WIDTH + TILE_SIZE - 1) / TILE_SIZE;
+const int TILES_Y = (CANVAS_HEIGHT + TILE_SIZE - 1) / TILE_SIZE;
+const int MAX_TILE_PRIMITIVES = 64;
+// Count of a tile with more than MAX_TILE_PRIMITIVES primitives, the fragment
+// shader evaluates all of them there.
+const GLuint TILE_OVERFLOW = 0xffffffff;
+// Uniform locations in the SPIR-V build of fshader.glsl, which can't be
+// looked up by name.
+const GLint PRIMITIVE_COUNT_LOCATION = 1;
+const GLint BINNING_LOCATION = 2;
+
+enum class Binning {none, cpu, compute};
+
+const char* binningName(Binning binning);
+// Inverse of binningName, throws on unknown names.
+Binning parseBinning(const std::string& name);
+
+// Same layout as the two texels per primitive in the "primitives" texture
+// buffer of fshader.glsl.
+struct Primitive {
+    enum Type {sphere, box};
+    float center[3];
+    float type;
+    float size[3]; // radius in x for spheres, whole edge lengths for boxes
+    float padding;
+};
+
+// The four objects which used to be hardcoded in the shader, followed by a
+// grid of small spheres and boxes behind them up to |objects| primitives.
+std::vector<Primitive> makeScene(int objects);
+
+// Project the bounds of |primitive| seen from |camera| to the screen, and
+// store them as {min x, min y, max x, max y} in pixels. Returns false if the
+// primitive can't be bounded, e.g. because it reaches behind the camera.
+bool projectBounds(const Primitive& primitive, const float camera[3],
+                   float bounds[4]);
+
+class TileBinner
+{
+public:
+    // Upload |primitives| and create the tile buffers. Falls back to binning
+    // on the CPU if compute shaders aren't supported.
+    TileBinner(const std::vector<Primitive>& primitives, Binning binning);
+    ~TileBinner();
+
+    Binning binning() const { return binning_; }
+
+    // Point the samplers and uniforms of |program| at the binner's buffers.
+    // SPIR-V programs have their samplers bound in the shader and use fixed
+    // uniform locations.
+    void setUniforms(GLuint program, bool spirv = false) const;
+
+    // Rebuild the tile lists for the camera of |scene|.
+    void update(const SceneUniforms& scene);
+
+    // Estimate of the average number of primitives evaluated per raymarching
+    // step from the tile lists, over the pixels which take any steps, i.e.
+    // those outside of empty tiles, assuming all of them take the same number
+    // of steps. StepCounter measures it.
+    double estimatePrimitives();
+
+private:
+    TileBinner(const TileBinner&) = delete;
+    TileBinner& operator=(const TileBinner&) = delete;
+
+    Binning binning_;
+    const std::vector<Primitive> primitives_;
+    GLint primitive_count_;
+    GLuint buffers_[3];  // primitives, tile counts, tile indices
+    GLuint textures_[3];
+    GLuint compute_program_ = 0;
+    std::vector<GLuint> counts_;
+    std::vector<GLuint> indices_;
+};
+
+#ifndef USE_GLES
+// Counts the raymarching steps and the primitives evaluated by them in the
+// programs built from fshader.glsl with COUNT_STEPS defined, for --bench.
+// Needs shader storage buffers.
+class StepCounter
+{
+public:
+    StepCounter();
+    ~StepCounter();
+
+    static bool supported();
+
+    // Zero the counters and bind them to |program|, which has to be current.
+    void reset(GLuint program);
+
+    // Average number of primitives evaluated per raymarching step in the
+    // frames drawn since reset().
+    double averagePrimitives();
+
+private:
+    StepCounter(const StepCounter&) = delete;
+    StepCounter& operator=(const StepCounter&) = delete;
+
+    GLuint buffer_;
+};
+#endif
+
+#endif /* end of include guard: BINNING_H */
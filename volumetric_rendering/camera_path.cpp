@@ -0,0 +1,69 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "camera_path.h"
+
+#include <iostream>
+#include <sstream>
+
+#include "common/error.h"
+#include "common/io.h"
+
+SceneUniforms defaultScene() {
+    return SceneUniforms{
+        {0.5, 0.2, -1, 1},
+        {1, 0.8, -0.8, 1},
+        {1, 1, 1, 1},
+        {0, 1, 1, 1},
+    };
+}
+
+CameraPath::CameraPath(const std::string& filepath) {
+    std::istringstream lines(readFile(filepath));
+    std::string line;
+    int number = 0;
+    while (std::getline(lines, line)) {
+        number++;
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream values(line);
+        Keyframe k;
+        values >> k.time >> k.camera[0] >> k.camera[1] >> k.camera[2]
+               >> k.light_position[0] >> k.light_position[1]
+               >> k.light_position[2];
+        if (!values ||
+                (!keyframes_.empty() && k.time <= keyframes_.back().time)) {
+            std::cerr << filepath << ":" << number << ": invalid keyframe"
+                      << std::endl;
+            throw Exception("Invalid camera path");
+        }
+        keyframes_.push_back(k);
+    }
+    if (keyframes_.empty())
+        throw Exception("Empty camera path");
+}
+
+void CameraPath::sample(float time, SceneUniforms* scene) const {
+    // index of the first keyframe after |time|, the path is short enough
+    // that a linear search doesn't matter
+    size_t next = 0;
+    while (next < keyframes_.size() && keyframes_[next].time <= time) next++;
+    const Keyframe& a = keyframes_[next == 0 ? 0 : next - 1];
+    const Keyframe& b = keyframes_[next == keyframes_.size() ? next - 1 : next];
+    float t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 0;
+    for (int i = 0; i < 3; i++) {
+        scene->camera[i] = a.camera[i] + t * (b.camera[i] - a.camera[i]);
+        scene->light_position[i] = a.light_position[i] +
+            t * (b.light_position[i] - a.light_position[i]);
+    }
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per-frame scene state shared with the fragment shader, and keyframed camera
+// paths to animate it.
+
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <string>
+#include <vector>
+
+// Same layout as the std140 uniform block "Scene" in fshader.glsl, every
+// member is a vec4 so there is no padding to worry about.
+struct SceneUniforms {
+    float camera[4];
+    float light_position[4];
+    float light_color[4];
+    float object_color[4];
+};
+
+// The scene as it used to be hardcoded in the shader.
+SceneUniforms defaultScene();
+
+struct Keyframe {
+    float time; // seconds
+    float camera[3];
+    float light_position[3];
+};
+
+class CameraPath
+{
+public:
+    // Load a path from a text file with one keyframe per line:
+    //   time camera.x camera.y camera.z light.x light.y light.z
+    // Times have to be increasing, lines starting with '#' are ignored.
+    explicit CameraPath(const std::string& filepath);
+
+    // Time of the last keyframe.
+    float duration() const { return keyframes_.back().time; }
+
+    // Set the camera and light in |scene| to their values at |time|, linearly
+    // interpolated between the surrounding keyframes.
+    void sample(float time, SceneUniforms* scene) const;
+
+private:
+    std::vector<Keyframe> keyframes_;
+};
+
+#endif /* end of include guard: CAMERA_PATH_H */
@@ -14,7 +14,34 @@
 
 // Draw a triangle. Created with the help of the tutorial on
 // https://open.gl/drawing. Uses SDL and GLEW.
+// Optionally takes a camera path file (see camera_path.h), which is played
+// back at a fixed 60 steps per second of path time, regardless of the actual
+// frame rate, and the program exits at its end. That makes the runs
+// reproducible, e.g. for benchmarking:
+//     ./bin/volumetric_rendering ../volumetric_rendering/paths/orbit.txt
+// Other options:
+//     --objects N        number of primitives in the scene, 4 by default
+//     --binning MODE     none, cpu (default) or compute, see binning.h; the
+//                        binned images differ from none on some box edge
+//                        pixels
+//     --bench            print frame times and primitives evaluated per step
+//                        for each binning mode and a growing number of
+//                        objects, then exit. The primitives are counted in an
+//                        extra frame if the driver has shader storage
+//                        buffers, and estimated from the tile lists otherwise
+//     --max-steps N      raymarching steps per pixel, 64 by default
+//     --spirv            load the SPIR-V build of the shaders (see
+//                        cmake/shaders.cmake) if the driver supports
+//                        ARB_gl_spirv, which disables shader reloading
+//     --compile-bench    print how long the driver takes to compile and link
+//                        the GLSL and the SPIR-V shaders without its on-disk
+//                        shader cache, then exit
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
 #include <GL/glew.h>
 #include <SDL.h>
 #include <SDL_opengl.h>
@@ -22,6 +49,20 @@
 #include "common/error.h"
 #include "common/io.h"
 #include "common/other.h"
+#include "common/reload.h"
+#include "common/sdl_telemetry.h"
+#include "common/telemetry.h"
+#include "binning.h"
+#include "camera_path.h"
+
+// attribute location of the vertex positions
+const GLuint POSITION_LOCATION = 0;
+// binding point of the uniform block with the scene state
+const GLuint SCENE_BINDING = 0;
+// path time advanced per frame
+const float FRAME_TIME = 1 / 60.0;
+// frames drawn for each configuration by --bench
+const int BENCH_FRAMES = 10;
 
 // canvas across the whole screen, so we can just paint with the fragment shader
 const float vertices[] = {
@@ -36,20 +77,80 @@ const float vertices[] = {
 };
 
 /**
- * Return ID of the linked and activated shader.
+ * Tuning knobs of fshader.glsl, with the constant_ids of its SPIR-V build.
+ * The shader has to use all of them, specializing a constant which isn't in
+ * the module fails.
+ */
+std::vector<ShaderConstant> fshaderKnobs(int max_steps) {
+    return {
+        {"MAX_STEPS", 0, float(max_steps), true},
+        {"EPSILON", 1, 0.001, false},
+        {"AMBIENT_LIGHT_STRENGTH", 2, 0.1, false},
+        {"SPECULAR_LIGHT_STRENGTH", 3, 0.1, false},
+        {"SPECULAR_LIGHT_SHININESS", 4, 128, false},
+    };
+}
+
+/**
+ * Return ID of the linked and activated shader, built from the SPIR-V shaders
+ * if |spirv| and from the GLSL ones otherwise, with |knobs| set. Prints how
+ * long the driver took to compile and link it.
  */
-GLuint initShaders() {
-    auto vshader = compileShader("vshader.glsl", ShaderType::vertex);
-    auto fshader = compileShader("fshader.glsl", ShaderType::fragment);
+GLuint initShaders(const std::vector<ShaderConstant>& knobs, bool spirv) {
+    auto start = std::chrono::steady_clock::now();
+    GLuint vshader, fshader;
+    if (spirv) {
+        vshader = loadSpirvShader("vshader.glsl", ShaderType::vertex);
+        fshader = loadSpirvShader("fshader.glsl", ShaderType::fragment, knobs);
+    } else {
+        vshader = compileShader("vshader.glsl", ShaderType::vertex);
+        fshader = compileShader("fshader.glsl", ShaderType::fragment, knobs);
+    }
     GLuint shaderProgram = glCreateProgram();
     glAttachShader(shaderProgram, vshader);
     glAttachShader(shaderProgram, fshader);
+    // keep the location fixed, so that reloaded programs match the VAO
+    glBindAttribLocation(shaderProgram, POSITION_LOCATION, "position");
     glLinkProgram(shaderProgram);
+    glDeleteShader(vshader);
+    glDeleteShader(fshader);
+    // waits for the driver to finish, it may compile in the background
+    GLint status;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+        throw Exception("program linking failed");
+    auto end = std::chrono::steady_clock::now();
+    printf("%s shaders compiled and linked in %.2f ms\n",
+           spirv ? "SPIR-V" : "GLSL",
+           std::chrono::duration<double, std::milli>(end - start).count());
     glUseProgram(shaderProgram);
     printGlErrors();
     return shaderProgram;
 }
 
+/**
+ * Print how long the driver takes to compile and link the GLSL shaders, and
+ * the SPIR-V ones if they are available.
+ */
+void benchmarkCompile(const std::vector<ShaderConstant>& knobs) {
+    // The first compile in the process pays for starting up the driver's
+    // compiler, keep that out of both measurements.
+    glDeleteShader(compileShader("vshader.glsl", ShaderType::vertex));
+    glDeleteProgram(initShaders(knobs, false));
+    if (spirvAvailable("vshader.glsl") && spirvAvailable("fshader.glsl"))
+        glDeleteProgram(initShaders(knobs, true));
+    else
+        printf("SPIR-V shaders not available\n");
+}
+
+void bindSceneBlock(GLuint shaderProgram) {
+    // SPIR-V programs have no block names, the binding is in the shader
+    GLuint index = glGetUniformBlockIndex(shaderProgram, "Scene");
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(shaderProgram, index, SCENE_BINDING);
+    printGlErrors();
+}
+
 SDL_GLContext initContext(SDL_Window *window) {
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
                         SDL_GL_CONTEXT_PROFILE_CORE);
@@ -64,7 +165,7 @@ SDL_GLContext initContext(SDL_Window *window) {
  * Copy buffers to memory, set shader attributes, bind to VAO.
  * Return bound VAO ID.
  */
-GLuint initBuffers(GLuint shaderProgram) {
+GLuint initBuffers() {
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -74,38 +175,199 @@ GLuint initBuffers(GLuint shaderProgram) {
     GLuint vao;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
-    GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
-    glEnableVertexAttribArray(posAttrib);
-    glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE,
+    glEnableVertexAttribArray(POSITION_LOCATION);
+    glVertexAttribPointer(POSITION_LOCATION, 2, GL_FLOAT, GL_FALSE,
                           3*sizeof(float), 0);
     printGlErrors();
     return vao;
 }
 
+/**
+ * Create the uniform buffer with the scene state and bind it.
+ * Return its ID.
+ */
+GLuint initSceneBuffer(const SceneUniforms& scene) {
+    GLuint ubo;
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(scene), &scene, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SCENE_BINDING, ubo);
+    printGlErrors();
+    return ubo;
+}
+
+void updateSceneBuffer(GLuint ubo, const SceneUniforms& scene) {
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(scene), &scene);
+}
+
 void paint() {
     glClear(GL_COLOR_BUFFER_BIT);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     printGlErrors();
 }
 
+/**
+ * Draw BENCH_FRAMES frames for each binning mode and number of objects, and
+ * print the average time of a frame and the primitives evaluated per step.
+ * Those are counted in one more frame drawn with |counting_program|, built
+ * with COUNT_STEPS, or estimated from the tile lists if it is 0.
+ */
+void benchmarkBinning(GLuint program, bool spirv, GLuint counting_program,
+                      const SceneUniforms& scene) {
+    std::unique_ptr<StepCounter> counter;
+    if (counting_program) {
+        counter.reset(new StepCounter());
+        printf("prims/step counted in an extra frame\n");
+    } else {
+        printf("prims/step estimated from the tile lists, no shader storage "
+               "buffers to count them\n");
+    }
+    printf("%8s %8s %10s %12s\n", "objects", "binning", "frame ms",
+           "prims/step");
+    for (int objects : {4, 16, 64, 256, 1024}) {
+        auto primitives = makeScene(objects);
+        for (auto mode : {Binning::none, Binning::cpu, Binning::compute}) {
+            TileBinner binner(primitives, mode);
+            if (binner.binning() != mode) continue; // no compute shaders
+            binner.setUniforms(program, spirv);
+            glFinish();
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < BENCH_FRAMES; i++) {
+                // the camera usually moves, so rebuild the lists every frame
+                binner.update(scene);
+                paint();
+                glFinish();
+            }
+            auto end = std::chrono::steady_clock::now();
+            double primitives;
+            if (counter) {
+                binner.setUniforms(counting_program);
+                glUseProgram(counting_program);
+                counter->reset(counting_program);
+                paint();
+                primitives = counter->averagePrimitives();
+                glUseProgram(program);
+            } else {
+                primitives = binner.estimatePrimitives();
+            }
+            printf("%8d %8s %10.2f %12.2f\n", objects, binningName(mode),
+                   std::chrono::duration<double, std::milli>(end - start)
+                       .count() / BENCH_FRAMES,
+                   primitives);
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
+    std::unique_ptr<CameraPath> path;
+    int objects = 4;
+    auto binning = Binning::cpu;
+    bool bench = false;
+    int max_steps = 64;
+    bool use_spirv = false;
+    bool compile_bench = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--objects" && i + 1 < argc)
+            objects = atoi(argv[++i]);
+        else if (arg == "--binning" && i + 1 < argc)
+            binning = parseBinning(argv[++i]);
+        else if (arg == "--bench")
+            bench = true;
+        else if (arg == "--max-steps" && i + 1 < argc)
+            max_steps = atoi(argv[++i]);
+        else if (arg == "--spirv")
+            use_spirv = true;
+        else if (arg == "--compile-bench")
+            compile_bench = true;
+        else
+            path.reset(new CameraPath(arg));
+    }
+
+    if (compile_bench) {
+        // Measure the compiler instead of the on-disk shader caches of Mesa
+        // and NVIDIA, unless asked otherwise.
+        setenv("MESA_SHADER_CACHE_DISABLE", "true", 0);
+        setenv("__GL_SHADER_DISK_CACHE", "0", 0);
+    }
+
     SDL_Init(SDL_INIT_VIDEO);
     SDL_Window* window = SDL_CreateWindow("Hello World",
                                            100, 100, 800, 800,
                                            SDL_WINDOW_OPENGL);
     auto context = initContext(window);
     initGlew();
-    auto program = initShaders();
-    initBuffers(program);
-
-    paint();
+    auto knobs = fshaderKnobs(max_steps);
+    if (compile_bench) {
+        benchmarkCompile(knobs);
+        SDL_GL_DeleteContext(context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 0;
+    }
+    bool spirv = use_spirv && spirvAvailable("vshader.glsl") &&
+                 spirvAvailable("fshader.glsl");
+    if (use_spirv && !spirv)
+        printf("SPIR-V shaders not available, using GLSL\n");
+    auto program = initShaders(knobs, spirv);
+    initBuffers();
+    bindSceneBlock(program);
+    auto scene = defaultScene();
+    auto ubo = initSceneBuffer(scene);
+    if (bench) {
+        GLuint counting_program = 0;
+        if (StepCounter::supported()) {
+            auto counting_knobs = knobs;
+            counting_knobs.push_back({"COUNT_STEPS", 0, 1, true});
+            counting_program = initShaders(counting_knobs, false);
+            bindSceneBlock(counting_program);
+            glUseProgram(program);
+        }
+        benchmarkBinning(program, spirv, counting_program, scene);
+        if (counting_program) glDeleteProgram(counting_program);
+    } else {
+        TileBinner binner(makeScene(objects), binning);
+        binner.setUniforms(program, spirv);
+        binner.update(scene);
+        // Reloading rebuilds from the GLSL sources, which would silently
+        // replace the SPIR-V program.
+        std::unique_ptr<ShaderReloader> reloader;
+        if (spirv) {
+            std::cerr << "[WARNING] shader reloading is disabled with SPIR-V, "
+                      << "run without --spirv to enable it" << std::endl;
+        } else {
+            reloader.reset(new ShaderReloader(program, "vshader.glsl",
+                                              "fshader.glsl"));
+            reloader->bindAttribLocation(POSITION_LOCATION, "position");
+            reloader->setConstants(ShaderType::fragment, knobs);
+        }
+        FrameTelemetry telemetry(refreshRate(window));
 
-    SDL_Event event;
-    while (true) {
-        if (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) break;
+        SDL_Event event;
+        for (int frame = 0; ; frame++) {
+            telemetry.startFrame();
+            if (SDL_PollEvent(&event)) {
+                if (event.type == SDL_QUIT) break;
+            }
+            telemetry.eventsDone();
+            auto reloaded = reloader ? reloader->update() : program;
+            if (reloaded != program) {
+                bindSceneBlock(reloaded);
+                binner.setUniforms(reloaded, false);
+                program = reloaded;
+            }
+            if (path) {
+                if (frame * FRAME_TIME > path->duration()) break;
+                path->sample(frame * FRAME_TIME, &scene);
+                updateSceneBuffer(ubo, scene);
+                binner.update(scene);
+            }
+            paint();
+            telemetry.paintDone();
+            SDL_GL_SwapWindow(window);
+            telemetry.swapDone();
         }
-        SDL_GL_SwapWindow(window);
     }
     SDL_GL_DeleteContext(context);
     SDL_DestroyWindow(window);
@@ -0,0 +1,82 @@
+#version 430
+// Build the per tile primitive lists read by fshader.glsl, one invocation per
+// tile. Same as TileBinner::update() in binning.cpp, which explains the math.
+#define WIDTH 800
+#define HEIGHT 800
+#define TILE_SIZE 32
+#define TILES_X 25
+#define TILES_Y 25
+#define MAX_TILE_PRIMITIVES 64
+#define TILE_OVERFLOW 0xffffffffu
+#define PRIMITIVE_SPHERE 0
+#define BOUNDS_MARGIN 0.01
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// SCENE_BINDING in main.cpp
+layout(std140, binding = 0) uniform Scene {
+    vec4 camera;
+    vec4 lightPosition;
+    vec4 lightColor;
+    vec4 objectColor;
+};
+
+layout(location = 0) uniform int primitiveCount;
+
+// the same buffers as the texture buffers of fshader.glsl
+layout(std430, binding = 0) readonly buffer Primitives {
+    vec4 primitives[];
+};
+layout(std430, binding = 1) writeonly buffer TileCounts {
+    uint tileCounts[];
+};
+layout(std430, binding = 2) writeonly buffer TileIndices {
+    uint tileIndices[];
+};
+
+// Screen space bounds of primitive |index| in pixels, as (min, max). Returns
+// false if it can't be bounded.
+bool projectBounds(int index, out vec4 bounds) {
+    if (camera.z >= 0) return false;
+    vec4 centerType = primitives[2 * index];
+    vec3 size = primitives[2 * index + 1].xyz;
+    vec3 halfSize = (int(centerType.w) == PRIMITIVE_SPHERE ? size.xxx
+                                                           : size / 2.0)
+                    + BOUNDS_MARGIN;
+    bounds = vec4(1e30, 1e30, -1e30, -1e30);
+    for (int corner = 0; corner < 8; corner++) {
+        vec3 p = centerType.xyz + mix(-halfSize, halfSize,
+            vec3(ivec3(corner, corner >> 1, corner >> 2) & 1));
+        float depth = p.z - camera.z;
+        if (depth <= 0) return false;
+        vec2 s = camera.xy + (p.xy - camera.xy) * (-camera.z / depth);
+        vec2 pixel = s * vec2(WIDTH, HEIGHT) + vec2(WIDTH, HEIGHT) / 2.0;
+        bounds.xy = min(bounds.xy, pixel);
+        bounds.zw = max(bounds.zw, pixel);
+    }
+    return true;
+}
+
+void main() {
+    ivec2 tile = ivec2(gl_GlobalInvocationID.xy);
+    if (tile.x >= TILES_X || tile.y >= TILES_Y) return;
+    int index = tile.y * TILES_X + tile.x;
+    uint count = 0;
+    for (int i = 0; i < primitiveCount; i++) {
+        vec4 bounds;
+        if (projectBounds(i, bounds)) {
+            ivec4 tiles = ivec4(clamp(floor(bounds / TILE_SIZE), vec4(-1),
+                                      vec4(TILES_X, TILES_Y, TILES_X, TILES_Y)));
+            if (any(lessThan(tile, tiles.xy)) ||
+                    any(greaterThan(tile, tiles.zw)))
+                continue;
+        }
+        if (count == MAX_TILE_PRIMITIVES) {
+            count = TILE_OVERFLOW;
+            break;
+        }
+        tileIndices[index * MAX_TILE_PRIMITIVES + count] = uint(i);
+        count++;
+    }
+    tileCounts[index] = count;
+}
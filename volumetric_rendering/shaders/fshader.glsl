@@ -1,20 +1,157 @@
 #version 150
+
+// Benchmark instrumentation, see StepCounter in binning.h. Extensions have to
+// be enabled before any other code.
+#ifdef COUNT_STEPS
+#extension GL_ARB_shader_storage_buffer_object : require
+#endif
+
+// Tuning knobs, set by fshaderKnobs() in main.cpp: specialization constants
+// in the SPIR-V build, macros inserted after #version otherwise. The defaults
+// are for hot reloading and offline validation.
+#ifdef GL_SPIRV
+layout(constant_id = 0) const int MAX_STEPS = 64;
+layout(constant_id = 1) const float EPSILON = 0.001;
+layout(constant_id = 2) const float AMBIENT_LIGHT_STRENGTH = 0.1;
+layout(constant_id = 3) const float SPECULAR_LIGHT_STRENGTH = 0.1;
+layout(constant_id = 4) const float SPECULAR_LIGHT_SHININESS = 128.0;
+#else
+#ifndef MAX_STEPS
 #define MAX_STEPS 64
+#endif
+#ifndef EPSILON
 #define EPSILON 0.001
+#endif
+#ifndef AMBIENT_LIGHT_STRENGTH
+#define AMBIENT_LIGHT_STRENGTH 0.1
+#endif
+#ifndef SPECULAR_LIGHT_STRENGTH
+#define SPECULAR_LIGHT_STRENGTH 0.1
+#endif
+#ifndef SPECULAR_LIGHT_SHININESS
+#define SPECULAR_LIGHT_SHININESS 128.0
+#endif
+#endif
+
+// Float precision of the distance and of the lighting code, only meaningful
+// on OpenGL ES, where volumetric_gles sets DISTANCE_MEDIUMP and
+// LIGHTING_MEDIUMP to 1 to try mediump for either.
+#ifndef DISTANCE_MEDIUMP
+#define DISTANCE_MEDIUMP 0
+#endif
+#ifndef LIGHTING_MEDIUMP
+#define LIGHTING_MEDIUMP 0
+#endif
+#if DISTANCE_MEDIUMP
+#define DISTANCE_PRECISION mediump
+#else
+#define DISTANCE_PRECISION highp
+#endif
+#if LIGHTING_MEDIUMP
+#define LIGHTING_PRECISION mediump
+#else
+#define LIGHTING_PRECISION highp
+#endif
+
+// SPIR-V has no names for the program to look things up by, so there the
+// uniforms and outputs get explicit locations and bindings, see binning.h.
+#ifdef GL_SPIRV
+#define SCENE_LAYOUT layout(std140, binding = 0)
+#define PRIMITIVES_LAYOUT layout(location = 0, binding = 0)
+#define PRIMITIVE_COUNT_LAYOUT layout(location = 1)
+#define BINNING_LAYOUT layout(location = 2)
+#define TILE_COUNTS_LAYOUT layout(location = 3, binding = 1)
+#define TILE_INDICES_LAYOUT layout(location = 4, binding = 2)
+#define OUT_COLOR_LAYOUT layout(location = 0)
+#else
+#define SCENE_LAYOUT layout(std140)
+#define PRIMITIVES_LAYOUT
+#define PRIMITIVE_COUNT_LAYOUT
+#define BINNING_LAYOUT
+#define TILE_COUNTS_LAYOUT
+#define TILE_INDICES_LAYOUT
+#define OUT_COLOR_LAYOUT
+#endif
 
-#define CAMERA vec3(0.5,0.2,-1)
 // canvas size, hardcoded for simplicity
-#define WIDTH 800
-#define HEIGHT 800
+#define WIDTH 800.0
+#define HEIGHT 800.0
 
-#define LIGHT_POSITION vec3(1, 0.8, -0.8)
-#define LIGHT_COLOR vec3(1, 1, 1)
-#define AMBIENT_LIGHT_STRENGTH 0.1
-#define SPECULAR_LIGHT_STRENGTH 0.1
-#define SPECULAR_LIGHT_SHININESS 128
+// Camera, light and material, updated by the program every frame. Only the
+// xyz (or rgb) parts are used, vec4s avoid any std140 padding surprises.
+SCENE_LAYOUT uniform Scene {
+    vec4 camera;
+    vec4 lightPosition;
+    vec4 lightColor;
+    vec4 objectColor;
+};
+
+#define CAMERA camera.xyz
+#define LIGHT_POSITION lightPosition.xyz
+#define LIGHT_COLOR lightColor.rgb
+
+// Screen space tiles, see binning.h.
+#define TILE_SIZE 32
+#define TILES_X 25
+#define MAX_TILE_PRIMITIVES 64
+#define TILE_OVERFLOW 0xffffffffu
+#define PRIMITIVE_SPHERE 0
+// bigger than any distance in the scene
+#define FAR 1e10
+
+// OpenGL ES 3.0 has no texture buffers, there the same texels are stored in
+// rows of BUFFER_TEXTURE_WIDTH in 2D textures, see binning.cpp.
+#ifdef GL_ES
+#define BUFFER_TEXTURE_WIDTH 1024
+#define SAMPLER_BUFFER sampler2D
+#define USAMPLER_BUFFER usampler2D
+#else
+#define SAMPLER_BUFFER samplerBuffer
+#define USAMPLER_BUFFER usamplerBuffer
+#endif
+
+// Two texels per primitive: (center, type) and (size, unused), the size is
+// the radius in x for spheres and the edge lengths for boxes.
+PRIMITIVES_LAYOUT uniform SAMPLER_BUFFER primitives;
+PRIMITIVE_COUNT_LAYOUT uniform int primitiveCount;
+// Whether to use the tile lists or evaluate every primitive everywhere.
+BINNING_LAYOUT uniform bool binning;
+// Number of primitives of each tile, or TILE_OVERFLOW to use all of them.
+TILE_COUNTS_LAYOUT uniform USAMPLER_BUFFER tileCounts;
+// MAX_TILE_PRIMITIVES primitive indices for each tile.
+TILE_INDICES_LAYOUT uniform USAMPLER_BUFFER tileIndices;
+
+#ifdef COUNT_STEPS
+// Two counters per tile: the raymarching steps taken in it and the primitives
+// evaluated by them.
+layout(std430) buffer StepCounts {
+    uint stepCounts[];
+};
+#endif
+
+OUT_COLOR_LAYOUT out vec4 outColor;
 
+// Texel |index| of a texture buffer, or of its 2D stand-in on OpenGL ES.
+#ifdef GL_ES
+ivec2 texelCoord(int index) {
+    return ivec2(index % BUFFER_TEXTURE_WIDTH, index / BUFFER_TEXTURE_WIDTH);
+}
+vec4 fetchTexel(sampler2D data, int index) {
+    return texelFetch(data, texelCoord(index), 0);
+}
+uvec4 fetchTexel(usampler2D data, int index) {
+    return texelFetch(data, texelCoord(index), 0);
+}
+#else
+vec4 fetchTexel(samplerBuffer data, int index) {
+    return texelFetch(data, index);
+}
+uvec4 fetchTexel(usamplerBuffer data, int index) {
+    return texelFetch(data, index);
+}
+#endif
 
-out vec4 outColor;
+precision DISTANCE_PRECISION float;
 
 // Signed distance function for a single sphere.
 float signedDistanceSphere(vec3 position, vec3 center, float radius) {
@@ -27,31 +164,32 @@ float signedDistanceBox(vec3 position, vec3 center, vec3 size) {
     return max(max(v.x, v.y), v.z);
 }
 
-// Get a minimum of 4 numbers.
-float min4(float a, float b, float c, float d) {
-    return min(min(min(a, b), c), d);
+// Signed distance function of the primitive with index |index|.
+float signedDistancePrimitive(vec3 position, int index) {
+    vec4 centerType = fetchTexel(primitives, 2 * index);
+    vec3 size = fetchTexel(primitives, 2 * index + 1).xyz;
+    if (int(centerType.w) == PRIMITIVE_SPHERE)
+        return signedDistanceSphere(position, centerType.xyz, size.x);
+    return signedDistanceBox(position, centerType.xyz, size);
 }
 
+// The primitives which can be seen in the tile of the current fragment, set
+// up by raymarch(). Either tileLength indices starting at tileStart in
+// tileIndices, or all of them if allPrimitives.
+int tileStart;
+int tileLength;
+bool allPrimitives;
+
 // Signed distance function for some objects - negative when inside of some
 // object, positive when outside, zero on the boundary.
-// TODO: use the model matrix to move around the objects
 float signedDistance(vec3 position) {
-    vec3 center = vec3(0, 0, 0.3);
-    float sphere_radius = 0.2;
-    return min4(
-               signedDistanceSphere(position - vec3(0.1, 0, 0),
-                                    center,
-                                    sphere_radius),
-               signedDistanceSphere(position + vec3(0.1, 0, 0),
-                                    center,
-                                    sphere_radius),
-               signedDistanceSphere(position + vec3(0, 0.15, 0),
-                                    center,
-                                    sphere_radius),
-               signedDistanceBox(position + vec3(0.4, 0.3, 0.1),
-                                    center,
-                                    vec3(0.2, 0.3, 0.1))
-    );
+    float dist = FAR;
+    for (int i = 0; i < tileLength; i++) {
+        int index = allPrimitives
+            ? i : int(fetchTexel(tileIndices, tileStart + i).r);
+        dist = min(dist, signedDistancePrimitive(position, index));
+    }
+    return dist;
 }
 
 // Guess what the normal of the surface is at this position by looking at nearby
@@ -67,20 +205,21 @@ vec3 estimateNormal(vec3 position) {
     return normalize(normal);
 }
 
+precision LIGHTING_PRECISION float;
+
 // Calculate Phong lighting for a single point at position.
 // https://learnopengl.com/#!Lighting/Basic-Lighting
 vec4 light(vec3 position, vec3 normal) {
     vec3 lightDirection = normalize(LIGHT_POSITION - position);
     vec3 reflectionDirection = reflect(lightDirection, normal);
     vec3 viewDirection = normalize(position - CAMERA);
-    vec3 objectColor = vec3(0,1,1);
 
     vec3 ambient = AMBIENT_LIGHT_STRENGTH * LIGHT_COLOR;
-    vec3 diffuse = max(dot(normal, lightDirection), 0) * LIGHT_COLOR;
+    vec3 diffuse = max(dot(normal, lightDirection), 0.0) * LIGHT_COLOR;
     float spec = pow(max(dot(viewDirection, reflectionDirection), 0.0),
                      SPECULAR_LIGHT_SHININESS);
     vec3 specular = SPECULAR_LIGHT_STRENGTH * spec * LIGHT_COLOR;
-    return vec4(objectColor * (ambient + diffuse + specular), 1);
+    return vec4(objectColor.rgb * (ambient + diffuse + specular), 1);
 }
 
 // Return the color of the object at this position.
@@ -89,6 +228,17 @@ vec4 renderSurface(vec3 position, vec3 viewDirection) {
     return light(position, normal);
 }
 
+// Add the |steps| raymarching steps of the current fragment to the counters of
+// tile |index|. Only with COUNT_STEPS.
+void countSteps(int index, int steps) {
+#ifdef COUNT_STEPS
+    atomicAdd(stepCounts[2 * index], uint(steps));
+    atomicAdd(stepCounts[2 * index + 1], uint(steps * tileLength));
+#endif
+}
+
+precision DISTANCE_PRECISION float;
+
 // Figure out the color of the current fragment by casting a ray from the camera
 // trough the current gl_FragCoord. Move along the ray by a step equal to the
 // distance to the nearest surface, given by the signed distance function, until
@@ -96,19 +246,35 @@ vec4 renderSurface(vec3 position, vec3 viewDirection) {
 // http://www.alanzucconi.com/2016/07/01/raymarching/
 vec4 raymarch() {
     // each pixel gets a coordinate between (-1,-1) and (1,1)
-    vec2 coord = vec2((gl_FragCoord.x - (WIDTH/2)) / WIDTH,
-                      (gl_FragCoord.y - (HEIGHT/2)) / HEIGHT);
+    vec2 coord = vec2((gl_FragCoord.x - (WIDTH/2.0)) / WIDTH,
+                      (gl_FragCoord.y - (HEIGHT/2.0)) / HEIGHT);
     vec3 position = vec3(coord, 0);
     vec3 viewDirection = normalize(position - CAMERA);
 
+    ivec2 tile = ivec2(gl_FragCoord.xy) / TILE_SIZE;
+    int index = tile.y * TILES_X + tile.x;
+    allPrimitives = true;
+    tileLength = primitiveCount;
+    if (binning) {
+        uint count = fetchTexel(tileCounts, index).r;
+        if (count != TILE_OVERFLOW) {
+            allPrimitives = false;
+            tileStart = index * MAX_TILE_PRIMITIVES;
+            tileLength = int(count);
+        }
+    }
+    if (tileLength == 0) return vec4(0,0,0,1); // nothing to hit
+
     for (int i = 0; i < MAX_STEPS; i++) {
         float dist = signedDistance(position);
         if (dist <= EPSILON) {
+            countSteps(index, i + 1);
             return renderSurface(position, viewDirection);
         } else {
             position += dist * viewDirection;
         }
     }
+    countSteps(index, MAX_STEPS);
     return vec4(0,0,0,1); // black
 }
 
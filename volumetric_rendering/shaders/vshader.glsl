@@ -1,4 +1,8 @@
 #version 150
+// the program binds it to location 0 by name, SPIR-V has no names
+#ifdef GL_SPIRV
+layout(location = 0)
+#endif
 in vec2 position;
 
 void main() {